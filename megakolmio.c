@@ -68,11 +68,11 @@ static const sint PRINTORDER[] = {6,2,0,1,7,3,4,5,8};
 
 ///////////////////////////////////////////////////////////////////////////////
 
-#define CARD_NAME_LEN 2
+#define CARD_NAME_LEN 16
 #define EDGES_IN_CARD 3
 
 typedef struct Card {
-    const char name[CARD_NAME_LEN];
+    char name[CARD_NAME_LEN+1];
     const char* edges[EDGES_IN_CARD];
 } Card;
 
@@ -92,6 +92,60 @@ static const Card Deck[] = {
 
 #define CARDS_IN_DECK (sizeof(Deck)/sizeof(Deck[0]))
 
+// Cards in play: Deck, or a deck read from a file given on the command line.
+// The file has a card per line: name and edges, e.g. "P1 FH FB DH". Blank
+// lines and lines starting with # are skipped, as in readDeck() of
+// megakolmio.hpp; a name longer than CARD_NAME_LEN, a bad edge or a deck
+// of other than CARDS_IN_DECK cards is refused.
+#define MAX_LINE 256
+
+static const Card* Cards = Deck;
+static Card LoadedDeck[CARDS_IN_DECK];
+static char LoadedEdges[CARDS_IN_DECK][EDGES_IN_CARD][3];
+
+static bool isEdge(const char* edge) {
+    return strlen(edge) == 2 && edge[0] >= 'A' && edge[0] <= 'Z' &&
+           (edge[1] == 'H' || edge[1] == 'B');
+}
+
+bool loadDeck(const char* path) {
+    FILE* f = fopen(path, "r");
+    if(f == NULL) return false;
+    char line[MAX_LINE + 2];
+    sint cards = 0;
+    bool ok = true;
+    while(ok && fgets(line, sizeof(line), f) != NULL) {
+        if(strchr(line, '\n') == NULL && !feof(f)) {
+            ok = false;
+            break;
+        }
+        char name[CARD_NAME_LEN + 2];
+        char edges[EDGES_IN_CARD][4];
+        char extra[2];
+        int fields = sscanf(line, "%17s %3s %3s %3s %1s", name,
+                            edges[0], edges[1], edges[2], extra);
+        if(fields <= 0 || name[0] == '#') continue;
+        if(fields != 1 + EDGES_IN_CARD || cards == CARDS_IN_DECK ||
+           strlen(name) > CARD_NAME_LEN) {
+            ok = false;
+            break;
+        }
+        Card* card = &LoadedDeck[cards];
+        strcpy(card->name, name);
+        for(sint e=0; e<EDGES_IN_CARD; e++) {
+            ok = ok && isEdge(edges[e]);
+            strncpy(LoadedEdges[cards][e], edges[e], 2);
+            LoadedEdges[cards][e][2] = '\0';
+            card->edges[e] = LoadedEdges[cards][e];
+        }
+        cards++;
+    }
+    fclose(f);
+    if(!ok || cards != CARDS_IN_DECK) return false;
+    Cards = LoadedDeck;
+    return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 typedef struct PlayedCard {
@@ -212,7 +266,7 @@ const Card* nextFromDeck(GameState* this) {
     }
     const Card* fromdeck = NULL;
     for(sint i=this->topOfTheDeck; i<CARDS_IN_DECK; i++) {
-        fromdeck = &Deck[i];
+        fromdeck = &Cards[i];
         if(!isCardOnBoard(this, fromdeck)) {
             this->topOfTheDeck = i;
             return fromdeck;
@@ -297,7 +351,12 @@ void solve(GameState* game) {
 
 ///////////////////////////////////////////////////////////////////////////////
 
-int main() {
+int main(int argc, char** argv) {
+    if(argc > 1 && !loadDeck(argv[1])) {
+        fprintf(stderr, "cannot read a deck of %d cards from %s\n",
+                (int)CARDS_IN_DECK, argv[1]);
+        return 1;
+    }
     GameState* game = calloc(1,sizeof(GameState));
     solve(game);
     delete(game);
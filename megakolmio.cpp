@@ -1,319 +1,489 @@
 ///////////////////////////////////////////////////////////////////////////////
 
-#include <iostream>
-#include <string>
-#include <vector>
-#include <unordered_map>
-#include <cstring>
-#include <algorithm>
+#include "megakolmio.hpp"
+#include "megakolmio_verify.hpp"
+#include "megakolmio_count.hpp"
+#include "megakolmio_cache.hpp"
+#include "megakolmio_server.hpp"
+#include "megakolmio_embedded.hpp"
+#include "megakolmio_repair.hpp"
+#include "megakolmio_local.hpp"
 
 ///////////////////////////////////////////////////////////////////////////////
 
-using namespace std;
-
-///////////////////////////////////////////////////////////////////////////////
-
-// NEIGHBORS:
-// Puzzle is filled starting from position 0 to 8 in order. Placing first cards
-// somewhere in the middle of the puzzle (as opposed to placing 0 on the top of
-// the board) will greatly improve the performance since it yields less 
-// solutions that end up non-completing late in the game.
-// Below IDs are used as indexes to GameState::mCardsOnBoard array.
-//
-//                 / \
-//                /   \
-//               /     \
-//              /   6   \
-//             /         \
-//             -----------
-//           / \         / \
-//          /   \   0   /   \
-//         /     \     /     \
-//        /   2   \   /   1   \
-//       /         \ /         \
-//       ----------- -----------
-//     / \         / \         / \
-//    /   \   3   /   \   5   /   \
-//   /     \     /     \     /     \
-//  /   7   \   /   4   \   /   8   \
-// /         \ /         \ /         \
-// ----------- ----------- -----------
-
-// EDGES:
-// Below IDs are used to identify edges:
-//
-//   Up:             Down:
-//       / \         -----------
-//      /   \        \    2    /
-//     /0   1\        \       /
-//    /       \        \1   0/
-//   /    2    \        \   /
-//   -----------         \ /
-//
-
-// Neighbor relations and common edges:
-typedef unsigned char sint;
-static unordered_map<string,sint> NEIGHBORMAP{
-    {"01", 0},
-    {"02", 1},
-    {"06", 2},
-    {"15", 2},
-    {"23", 2},
-    {"34", 0},
-    {"37", 1},
-    {"45", 1},
-    {"58", 0}    // cards on positions 5 and 8 have a common edge 0
-};
-
-static const sint PRINTORDER[] = {6,2,0,1,7,3,4,5,8};
-
-///////////////////////////////////////////////////////////////////////////////
-
-class Card {
-    public:
-    string mName;
-    vector<string> mEdges;
-
-    Card(string name, vector<string> edges) {
-        mName = name;
-        mEdges = edges;
-    }
-};
-
-///////////////////////////////////////////////////////////////////////////////
-
-struct Deck {
-    static const Card cards[];
-};
-
-const Card Deck::cards[] = {
-    Card("P1",{"FH","FB","DH"}),
-    Card("P2",{"DH","FB","RB"}),
-    Card("P3",{"DH","FB","FH"}),
-    Card("P4",{"DH","DB","FB"}),
-    Card("P5",{"DH","RB","DB"}),
-    Card("P6",{"RB","FB","RH"}),
-    Card("P7",{"FB","RH","FH"}),
-    Card("P8",{"RH","DH","RB"}),
-    Card("P9",{"FB","DB","DH"})
-};
-
-static const int CARDS_IN_DECK = sizeof(Deck::cards)/sizeof(Deck::cards[0]); 
-static const int EDGES_IN_CARD = Deck::cards[0].mEdges.size();
-
-///////////////////////////////////////////////////////////////////////////////
-
-class PlayedCard {
-    public:
-    sint mRotation;
-    sint mPosition;
-    const Card *mCard;
-
-    PlayedCard(const Card *card = NULL, sint position = 0, sint rotation = 0) {
-        mCard = card;
-        mPosition = position;
-        mRotation = rotation;
-    }
+// Time budget of --local-search without --deadline
+static const uint32_t LOCAL_BUDGET = 10000;
+
+static void usage() {
+    cerr << "usage: megakolmio [--threads=N] [--no-numa] [--no-learning] [--trace=FILE]" << endl
+         << "                  [--progress=SECONDS] [--status-file=PATH] [DECK]" << endl
+         << "                  [--format=binary] [--verify=SOLUTIONS]" << endl
+         << "                  [--count[=frontier|search]] [--domains] [--cache=DIR]" << endl
+         << "                  [--serve=SOCKET] [--connect=SOCKET] [--deadline=MS]" << endl
+         << "                  [--sample=N] [--estimate=PROBES] [--seed=S]" << endl
+         << "                  [--marginals] [--max-matching] [--local-search]" << endl
+         << "  DECK         file with a card per line, e.g. \"P1 FH FB DH\"," << endl
+         << "               instead of the built-in deck; n*n cards are played" << endl
+         << "               on a triangle of side n" << endl
+         << "  --threads=N  search with N workers, solutions are printed" << endl
+         << "               in the order they are found" << endl
+         << "  --no-numa    do not pin workers or replicate the tables per" << endl
+         << "               NUMA node" << endl
+         << "  --no-learning" << endl
+         << "               do not share what dead ends were caused by between" << endl
+         << "               parts of the search" << endl
+         << "  --trace=FILE write the trace ring buffers to FILE on SIGUSR1" << endl
+         << "               and at exit (needs -DMEGAKOLMIO_TRACE)" << endl
+         << "  --progress=SECONDS" << endl
+         << "               report rate, depths, finished branches and time" << endl
+         << "               left to stderr every SECONDS (implies --threads=1)" << endl
+         << "  --status-file=PATH" << endl
+         << "               write the progress reports to PATH instead" << endl
+         << "  --format=binary" << endl
+         << "               print solutions as binary records with rotations" << endl
+         << "  --verify=SOLUTIONS" << endl
+         << "               check a text or binary solution file against the" << endl
+         << "               deck and report the first invalid record" << endl
+         << "  --count      print the number of solutions without listing them," << endl
+         << "               merging partial boards over the frontier, or by" << endl
+         << "               running the search when too few of them merge;" << endl
+         << "               --count=frontier and --count=search pick one" << endl
+         << "  --domains    print how many placements of a card and rotation" << endl
+         << "               are left on each cell after removing those that a" << endl
+         << "               neighbor cannot match" << endl
+         << "  --cache=DIR  answer from DIR if the deck, up to card order," << endl
+         << "               rotations and animal names, was solved before, and" << endl
+         << "               store the solutions there otherwise" << endl
+         << "  --serve=SOCKET" << endl
+         << "               solve the decks sent to the Unix socket SOCKET on" << endl
+         << "               one pool of --threads=N workers (default all cores)" << endl
+         << "  --connect=SOCKET" << endl
+         << "               have the service on SOCKET solve the deck" << endl
+         << "  --deadline=MS" << endl
+         << "               with --connect, --max-matching or --local-search," << endl
+         << "               stop after MS milliseconds" << endl
+         << "  --sample=N   print N solutions drawn uniformly at random, from" << endl
+         << "               the counts of --count" << endl
+         << "  --estimate=PROBES" << endl
+         << "               estimate the number of solutions from PROBES random" << endl
+         << "               paths down the search tree, on --threads=N workers," << endl
+         << "               with a 95% confidence interval" << endl
+         << "  --seed=S     seed of --sample, --estimate and --local-search," << endl
+         << "               random by default" << endl
+         << "  --marginals  print how many solutions have each card on each cell" << endl
+         << "               in each rotation, counted while searching" << endl
+         << "  --max-matching" << endl
+         << "               print a board with as many matching edges as" << endl
+         << "               possible, for decks without a solution" << endl
+         << "  --local-search" << endl
+         << "               look for a solution by simulated annealing on" << endl
+         << "               --threads=N chains, on boards up to side " << MAX_LOCAL_SIDE << "," << endl
+         << "               and print the best board found within --deadline" << endl
+         << "               (default " << LOCAL_BUDGET << " ms)" << endl;
+}
 
-    bool matchesNeighbor(PlayedCard *other) {
-        if (mCard == NULL) { return false; }
-        sint common_edge = NEIGHBORMAP[to_string(mPosition)+to_string(other->mPosition)];
-        sint own_rotated_common_edge = (common_edge + mRotation) % EDGES_IN_CARD;
-        sint other_rotated_common_edge = (common_edge + other->mRotation) % EDGES_IN_CARD;
-        string e1 = this->mCard->mEdges[own_rotated_common_edge];
-        string e2 = other->mCard->mEdges[other_rotated_common_edge];
-        if(e1[0] == e2[0] && e1[1] != e2[1] ) {
-            return true;
+int main(int argc, char** argv) {
+    int threads = 0;
+    bool numa = true;
+    bool learning = true;
+    double interval = 0;
+    string statusPath;
+    const char* deckPath = NULL;
+    const char* verifyPath = NULL;
+    bool binary = false;
+    const char* count = NULL;
+    bool domains = false;
+    const char* cachePath = NULL;
+    const char* servePath = NULL;
+    bool tracing = false;
+    long samples = 0;
+    long probes = 0;
+    bool marginals = false;
+    bool maxMatching = false;
+    bool localSearch = false;
+    uint64_t seed = random_device()();
+    const char* connectPath = NULL;
+    uint32_t deadline = 0;
+    for(int i=1; i<argc; i++) {
+        if(strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+            if(threads < 1) { usage(); return 1; }
         }
-        else {
-            return false;
+        else if(strcmp(argv[i], "--no-numa") == 0) {
+            numa = false;
         }
-    }
-
-    bool rotate() {
-        if (mRotation >= 2) {
-            return false;
+        else if(strcmp(argv[i], "--no-learning") == 0) {
+            learning = false;
+        }
+        else if(strncmp(argv[i], "--progress=", 11) == 0) {
+            interval = atof(argv[i] + 11);
+            if(interval <= 0) { usage(); return 1; }
+        }
+        else if(strncmp(argv[i], "--status-file=", 14) == 0) {
+            statusPath = argv[i] + 14;
+        }
+        else if(strncmp(argv[i], "--trace=", 8) == 0) {
+#ifdef MEGAKOLMIO_TRACE
+            if(!startTrace(argv[i] + 8)) {
+                cerr << "megakolmio: cannot trace to " << argv[i] + 8 << endl;
+                return 1;
+            }
+            atexit(dumpTrace);
+            tracing = true;
+#else
+            cerr << "megakolmio: built without -DMEGAKOLMIO_TRACE" << endl;
+            return 1;
+#endif
+        }
+        else if(strcmp(argv[i], "--format=binary") == 0) {
+            binary = true;
+        }
+        else if(strcmp(argv[i], "--format=text") == 0) {
+            binary = false;
+        }
+        else if(strncmp(argv[i], "--verify=", 9) == 0) {
+            verifyPath = argv[i] + 9;
+        }
+        else if(strcmp(argv[i], "--count") == 0) {
+            count = "auto";
+        }
+        else if(strcmp(argv[i], "--count=frontier") == 0) {
+            count = "frontier";
+        }
+        else if(strcmp(argv[i], "--count=search") == 0) {
+            count = "search";
+        }
+        else if(strcmp(argv[i], "--domains") == 0) {
+            domains = true;
+        }
+        else if(strncmp(argv[i], "--cache=", 8) == 0 && argv[i][8]) {
+            cachePath = argv[i] + 8;
+        }
+        else if(strncmp(argv[i], "--serve=", 8) == 0 && argv[i][8]) {
+            servePath = argv[i] + 8;
+        }
+        else if(strncmp(argv[i], "--connect=", 10) == 0 && argv[i][10]) {
+            connectPath = argv[i] + 10;
+        }
+        else if(strncmp(argv[i], "--deadline=", 11) == 0) {
+            deadline = strtoul(argv[i] + 11, NULL, 10);
+        }
+        else if(strncmp(argv[i], "--sample=", 9) == 0) {
+            samples = atol(argv[i] + 9);
+            if(samples < 1) { usage(); return 1; }
+        }
+        else if(strncmp(argv[i], "--estimate=", 11) == 0) {
+            probes = atol(argv[i] + 11);
+            if(probes < 1) { usage(); return 1; }
+        }
+        else if(strcmp(argv[i], "--local-search") == 0) {
+            localSearch = true;
+        }
+        else if(strcmp(argv[i], "--max-matching") == 0) {
+            maxMatching = true;
+        }
+        else if(strcmp(argv[i], "--marginals") == 0) {
+            marginals = true;
+        }
+        else if(strncmp(argv[i], "--seed=", 7) == 0) {
+            seed = strtoull(argv[i] + 7, NULL, 10);
+        }
+        else if(argv[i][0] != '-' && deckPath == NULL) {
+            deckPath = argv[i];
         }
         else {
-            mRotation += 1;
-            return true;
+            usage();
+            return 1;
         }
     }
-};
 
-///////////////////////////////////////////////////////////////////////////////
+    if(!statusPath.empty() && interval <= 0) {
+        interval = 10;
+    }
+    if(interval > 0 && threads == 0) {
+        threads = 1;
+    }
 
-class GameState {
-    public:
-    sint mNextOnBoard;
-    sint mTopOfTheDeck;
-    PlayedCard* mCardsOnBoard[CARDS_IN_DECK];
-    
-    GameState() {
-        memset(mCardsOnBoard, 0, sizeof(mCardsOnBoard));
-        mNextOnBoard = mTopOfTheDeck = 0;
+    if(servePath) {
+        SolverService service(threads > 0 ? threads : max(1u, thread::hardware_concurrency()));
+        string error;
+        service.serve(servePath, error);
+        cerr << "megakolmio: " << error << endl;
+        return 1;
     }
 
-    ~GameState() {
-        for(sint i=0; i<CARDS_IN_DECK; i++) {
-            if(mCardsOnBoard[i]) {
-                delete mCardsOnBoard[i];
-            }
+    vector<Card> deck(Deck::cards, Deck::cards + CARDS_IN_DECK);
+    if(deckPath) {
+        ifstream in(deckPath);
+        string error;
+        if(!in) {
+            cerr << "megakolmio: cannot open " << deckPath << endl;
+            return 1;
+        }
+        if(!readDeck(in, deck, error, localSearch ? MAX_LOCAL_CARDS : MAX_CARDS)) {
+            cerr << "megakolmio: " << deckPath << ": " << error << endl;
+            return 1;
         }
     }
 
-    GameState* replicate() {
-        GameState *newstate = new GameState();
-        newstate->mNextOnBoard = this->mNextOnBoard;
-        newstate->mTopOfTheDeck = this->mTopOfTheDeck;
-        for(sint i=0; i<CARDS_IN_DECK; i++) {
-            if(this->mCardsOnBoard[i] == NULL) break;
-            newstate->mCardsOnBoard[i] = 
-            new PlayedCard(
-                this->mCardsOnBoard[i]->mCard,
-                this->mCardsOnBoard[i]->mPosition,
-                this->mCardsOnBoard[i]->mRotation);
-        }
-        return newstate;
+    if(localSearch) {
+        LocalSearch local(deck.data(), deck.size(),
+                          threads > 0 ? threads : thread::hardware_concurrency(), seed);
+        if(interval > 0) {
+            local.mOnImprove = [&local](int mismatched) {
+                cerr << "matched " << local.mEdges - mismatched << " of " << local.mEdges << endl;
+            };
+        }
+        int mismatched = local.solve(chrono::milliseconds(deadline > 0 ? deadline : LOCAL_BUDGET));
+        vector<int> cell(local.mCells);
+        for(int i=0; i<local.mCells; i++) cell[local.mBoard.mPrintOrder[i]] = i;
+        local.output(cout);
+        cout << "matched " << local.mEdges - mismatched << " of " << local.mEdges << " edges" << endl;
+        for(const auto& edge : local.mismatches()) {
+            cout << "mismatch: cells " << cell[edge.first] << " and " << cell[edge.second] << endl;
+        }
+        return 0;
     }
+    DeckTables tables;
+    tables.build(deck.data(), deck.size());
 
-    bool isSolved(bool partial=false) {
-        PlayedCard *c1, *c2;
-        for(const auto& i : NEIGHBORMAP)
-        {
-            string key = i.first;
-            sint n1 = key[0] - '0'; // '1' to 1 etc.
-            sint n2 = key[1] - '0';
-            c1 = mCardsOnBoard[n1];
-            c2 = mCardsOnBoard[n2];
-            if (c1 == NULL || c2 == NULL) {
-                if (partial) {
-                    continue;
-                }
-                else {
-                    return false;
-                }
+    if(connectPath) {
+        if(binary) {
+            writeBinaryHeader(cout, tables.mCards);
+        }
+        Search search(&tables);
+        auto print = [&](const char* record) {
+            if(binary) {
+                cout.write(record, tables.mCards);
+                return;
             }
-            if (not c1->matchesNeighbor(c2)) {
-                return false;
+            for(sint i=0; i<tables.mCards; i++) {
+                sint p = tables.mPrintOrder[i];
+                search.mCard[p] = record[i] & 63;
+                search.mRotation[p] = (unsigned char)record[i] >> 6;
             }
-        }
-        return true;
+            search.output(cout);
+        };
+        string reason;
+        int status = requestSolutions(connectPath, deck, deadline, 0, print, reason);
+        if(status != STATUS_COMPLETE) cerr << "megakolmio: " << reason << endl;
+        return status == STATUS_COMPLETE ? 0 : 1;
     }
 
-    void output() {
-        cout << "[";
-        for(sint i=0; i<CARDS_IN_DECK; i++) {
-            cout << mCardsOnBoard[PRINTORDER[i]]->mCard->mName;
-            if (i < CARDS_IN_DECK-1) cout << ",";
+    if(verifyPath) {
+        ifstream in(verifyPath, ios::binary);
+        if(!in) {
+            cerr << "megakolmio: cannot open " << verifyPath << endl;
+            return 1;
+        }
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        Verifier verifier(&tables, threads > 0 ? threads : thread::hardware_concurrency());
+        string error;
+        if(!verifier.verify(data.data(), data.size(), error)) {
+            cerr << "megakolmio: " << verifyPath << ": " << error << endl;
+            return 1;
+        }
+        if(verifier.mInvalidRecord) {
+            cout << "record " << verifier.mInvalidRecord;
+            if(verifier.mInvalidLine) cout << " (line " << verifier.mInvalidLine << ")";
+            cout << " is invalid: " << verifier.mReason << endl;
+            return 1;
         }
-        cout << "]" << endl;
+        cout << verifier.mRecords << " solutions are valid" << endl;
+        return 0;
     }
 
-    bool isCardOnBoard(const Card* value) {
-        for (sint i=0; i<CARDS_IN_DECK; ++i) {
-            if (mCardsOnBoard[i] != NULL && 
-                mCardsOnBoard[i]->mCard != NULL &&
-                mCardsOnBoard[i]->mCard == value) {
-                return true;
+    // Before filter(): the best near-solution may use placements that no
+    // solution can have.
+    if(maxMatching) {
+        MatchMaximizer maximizer(&tables, threads > 0 ? threads : thread::hardware_concurrency());
+        atomic<bool> cancel(false);
+        mutex lock;
+        condition_variable wake;
+        bool finished = false;
+        thread timer;
+        if(deadline > 0) {
+            maximizer.mCancel = &cancel;
+            timer = thread([&] {
+                unique_lock<mutex> guard(lock);
+                if(!wake.wait_for(guard, chrono::milliseconds(deadline), [&] { return finished; })) {
+                    cancel = true;
+                }
+            });
+        }
+        if(interval > 0) {
+            maximizer.mOnImprove = [&maximizer](const Search&, int matched) {
+                cerr << "matched " << matched << " of " << maximizer.mEdges << endl;
+            };
+        }
+        int matched = maximizer.solve();
+        if(timer.joinable()) {
+            {
+                lock_guard<mutex> guard(lock);
+                finished = true;
             }
+            wake.notify_all();
+            timer.join();
         }
-        return false;
+        vector<sint> cell(tables.mCards);
+        for(sint i=0; i<tables.mCards; i++) cell[tables.mPrintOrder[i]] = i;
+        cout << "[";
+        for(sint i=0; i<tables.mCards; i++) {
+            sint p = tables.mPrintOrder[i];
+            cout << deck[maximizer.mBoard.mCard[p]].mName << ":" << (int)maximizer.mBoard.mRotation[p]
+                 << (i + 1 < tables.mCards ? "," : "]\n");
+        }
+        cout << "matched " << matched << " of " << maximizer.mEdges << " edges"
+             << (maximizer.mComplete ? "" : ", search stopped before proving it best") << endl;
+        for(const auto& edge : maximizer.mismatches()) {
+            cout << "mismatch: cells " << (int)cell[edge[0]] << " and " << (int)cell[edge[1]] << endl;
+        }
+        return 0;
     }
 
-    const Card* nextFromDeck() {
-        if(mTopOfTheDeck >= CARDS_IN_DECK) {
-            return NULL;
-        }
-        const Card* fromdeck = NULL;
-        for(sint i=mTopOfTheDeck; i<CARDS_IN_DECK; i++) {
-            fromdeck = &Deck::cards[i];
-            if(not isCardOnBoard(fromdeck)) {
-                mTopOfTheDeck = i;
-                return fromdeck;
-            }
-
+    // The verifier checks against the full tables, the search gets them
+    // without the placements no solution can have. A deck is infeasible
+    // when filter() empties a cell or card or when it is not balanced.
+    tables.filter();
+    bool feasible = tables.feasible();
+    if(domains) {
+        int total = 0;
+        for(sint i=0; i<tables.mCards; i++) {
+            int size = tables.domainSize(tables.mPrintOrder[i]);
+            cout << "cell " << (int)i << ": " << size << " of "
+                 << tables.mCards * EDGES_IN_CARD << endl;
+            total += size;
         }
-        return NULL;
+        cout << "total: " << total << " of "
+             << tables.mCards * tables.mCards * EDGES_IN_CARD << endl;
+        if(!feasible) cout << "no solutions" << endl;
+        return 0;
     }
 
-    bool addNewCard() {
-        const Card *fromdeck = this->nextFromDeck();
-        if(fromdeck == NULL) {
-            return false;
-        }
-        PlayedCard *newcard = new PlayedCard(fromdeck, mNextOnBoard);
-        mCardsOnBoard[newcard->mPosition] = newcard;
-        mNextOnBoard++;
-        return true;
+    if(count && strcmp(count, "search") != 0) {
+        FrontierCounter counter(&tables);
+        if(strcmp(count, "auto") == 0) counter.mMaxStates = FRONTIER_LIMIT;
+        Count total = counter.count();
+        if(!counter.mGaveUp) {
+            cout << total << endl;
+            return 0;
+        }
     }
-
-    bool replaceCard(PlayedCard *card) {
-        const Card *fromdeck = this->nextFromDeck();
-        if(fromdeck == NULL) {
-            return false;
-        }
-        card->mCard = fromdeck;
-        card->mRotation = 0;
-        return true;
+    if(samples) {
+        FrontierCounter counter(&tables);
+        counter.mKeepLayers = true;
+        counter.count();
+        if(binary) {
+            writeBinaryHeader(cout, tables.mCards);
+        }
+        Search search(&tables);
+        mt19937_64 random(seed);
+        for(long i=0; i<samples && counter.sample(random, search.mCard, search.mRotation); i++) {
+            if(binary) writeBinarySolution(cout, search);
+            else search.output(cout);
+        }
+        return 0;
     }
-
-    PlayedCard* getLastAdded() {
-        sint last = mNextOnBoard - 1;
-        return mCardsOnBoard[last];
+    if(probes) {
+        CountEstimator estimator(&tables);
+        estimator.run(feasible ? probes : 0, threads > 0 ? threads : thread::hardware_concurrency(), seed);
+        cout << setprecision(6) << "estimate: " << estimator.mMean << endl
+             << "95% interval: " << estimator.low() << " to " << estimator.high() << endl
+             << "probes: " << estimator.mProbes << ", " << estimator.mHits << " filled the board" << endl;
+        if(!feasible) cout << "no solutions" << endl;
+        return 0;
     }
-
-    GameState* first() {
-        GameState *newstate = this->replicate();
-        newstate->mTopOfTheDeck = 0;
-        if(!newstate->addNewCard()) {
-            delete newstate;
-            return NULL;
-        }
-        return newstate;
+    unique_ptr<NogoodStore> nogoods(learning ? new NogoodStore() : NULL);
+    if(count) {
+        Count total;
+        auto tally = [&total](const Search&) { total += 1; };
+        if(threads > 0) {
+            ParallelSolver solver(&tables, threads, numa, interval, statusPath);
+            solver.mNogoods = nogoods.get();
+            solver.mOnSolution = tally;
+            solver.solve();
+        }
+        else {
+            Search search(&tables);
+            search.mNogoods = nogoods.get();
+            search.solve(0, tally);
+        }
+        cout << total << endl;
+        return 0;
     }
-
-    GameState* next() {
-        GameState *newstate = this->replicate();
-        PlayedCard *card = newstate->getLastAdded();
-        if (card->rotate()) {
-            return newstate;
+    if(marginals) {
+        Marginals histogram(&tables, threads);
+        if(threads > 0) {
+            ParallelSolver solver(&tables, threads, numa, interval, statusPath);
+            solver.mNogoods = nogoods.get();
+            solver.mOnWorkerSolution = [&histogram](int worker, const Search& s) {
+                histogram.add(worker, s);
+            };
+            solver.solve();
         }
-        else if (!newstate->replaceCard(card)) {
-            delete newstate;
-            return NULL;
+        else {
+            Search search(&tables);
+            search.mNogoods = nogoods.get();
+            auto add = [&histogram](const Search& s) { histogram.add(0, s); };
+            search.solve(0, add);
         }
-        return newstate;
+        histogram.merge();
+        histogram.output(cout, deck);
+        return 0;
     }
-};
 
-///////////////////////////////////////////////////////////////////////////////
-
-void solve(GameState* game) {
-    if(!game->isSolved(true)) {
-        return;
+    // Solutions found are also kept in canonical terms for the cache.
+    unique_ptr<CanonicalDeck> canonical(cachePath ? new CanonicalDeck(deck) : NULL);
+    ResultCache cache(cachePath ? cachePath : "");
+    vector<char> records;
+    auto print = [binary, &canonical, &records](const Search& s) {
+        if(canonical) ResultCache::record(*canonical, s, records);
+        if(binary) writeBinarySolution(cout, s);
+        else s.output(cout);
+    };
+    if(binary) {
+        writeBinaryHeader(cout, tables.mCards);
     }
 
-    if(game->isSolved()) {
-        game->output();
+    if(canonical && cache.load(*canonical, records)) {
+        Search search(&tables);
+        for(size_t i=0; i<records.size(); i+=tables.mCards) {
+            ResultCache::replay(*canonical, &records[i], search);
+            if(binary) writeBinarySolution(cout, search);
+            else search.output(cout);
+        }
+        return 0;
     }
 
-    GameState *tempstate = NULL;
-    GameState *newstate = game->first();
-    while(newstate != NULL) {
-        solve(newstate);
-        tempstate = newstate;
-        newstate = newstate->next();
-        delete tempstate;
+    if(threads > 0) {
+        ParallelSolver solver(&tables, threads, numa, interval, statusPath);
+        solver.mNogoods = nogoods.get();
+        solver.mOnSolution = print;
+        solver.solve();
     }
-}
-
-///////////////////////////////////////////////////////////////////////////////
-
-int main() {
-    GameState* game = new GameState();
-    solve(game);
-    delete game;
+    // GameState plays only the built-in board and prints text, the rest goes
+    // to the fast search which finds the solutions in the same order.
+    else if(deckPath || binary || canonical) {
+        Search search(&tables);
+        search.mNogoods = nogoods.get();
+        search.solve(0, print);
+    }
+    // The built-in puzzle was solved by the compiler, GameState is only
+    // run when its trace is wanted.
+    else if(tracing) {
+        GameState* game = new GameState();
+        solve(game);
+        delete game;
+        return 0;
+    }
+    else {
+        cout.write(EMBEDDED_TEXT.mText, EMBEDDED_TEXT.mSize);
+        return 0;
+    }
+    if(canonical && !cache.store(*canonical, records)) {
+        cerr << "megakolmio: cannot write to " << cachePath << endl;
+    }
+    return 0;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
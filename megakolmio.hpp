@@ -0,0 +1,1642 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MEGAKOLMIO_HPP
+#define MEGAKOLMIO_HPP
+
+// The solver engines shared by megakolmio and its tools. Like the rest of
+// the project this is one translation unit per program, so the header holds
+// definitions and is meant to be included once per executable.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <condition_variable>
+#include <array>
+#include <functional>
+#include <memory>
+#include <cstdio>
+#include <cmath>
+#include <climits>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+#include "megakolmio_trace.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// NEIGHBORS:
+// Puzzle is filled starting from position 0 to 8 in order. Placing first cards
+// somewhere in the middle of the puzzle (as opposed to placing 0 on the top of
+// the board) will greatly improve the performance since it yields less 
+// solutions that end up non-completing late in the game.
+// Below IDs are used as indexes to GameState::mCardsOnBoard array.
+//
+//                 / \
+//                /   \
+//               /     \
+//              /   6   \
+//             /         \
+//             -----------
+//           / \         / \
+//          /   \   0   /   \
+//         /     \     /     \
+//        /   2   \   /   1   \
+//       /         \ /         \
+//       ----------- -----------
+//     / \         / \         / \
+//    /   \   3   /   \   5   /   \
+//   /     \     /     \     /     \
+//  /   7   \   /   4   \   /   8   \
+// /         \ /         \ /         \
+// ----------- ----------- -----------
+
+// EDGES:
+// Below IDs are used to identify edges:
+//
+//   Up:             Down:
+//       / \         -----------
+//      /   \        \    2    /
+//     /0   1\        \       /
+//    /       \        \1   0/
+//   /    2    \        \   /
+//   -----------         \ /
+//
+
+// Neighbor relations and common edges, as earlier position, later position
+// and common edge. These and the tables below are constant expressions so
+// that megakolmio_embedded.hpp can solve the built-in puzzle from them.
+typedef unsigned char sint;
+static constexpr sint NEIGHBORS[][3] = {
+    {0, 1, 0},
+    {0, 2, 1},
+    {0, 6, 2},
+    {1, 5, 2},
+    {2, 3, 2},
+    {3, 4, 0},
+    {3, 7, 1},
+    {4, 5, 1},
+    {5, 8, 0}    // cards on positions 5 and 8 have a common edge 0
+};
+
+// NEIGHBORS by the two positions as a string, e.g. "58".
+static unordered_map<string,sint> NEIGHBORMAP = [] {
+    unordered_map<string,sint> map;
+    for(const auto& n : NEIGHBORS) map[to_string(n[0]) + to_string(n[1])] = n[2];
+    return map;
+}();
+
+static constexpr sint PRINTORDER[] = {6,2,0,1,7,3,4,5,8};
+
+///////////////////////////////////////////////////////////////////////////////
+
+static const int EDGES_IN_CARD = 3;
+
+// A card as constant text, for the built-in deck.
+struct CardText {
+    const char* mName;
+    const char* mEdges[EDGES_IN_CARD];
+};
+
+static constexpr CardText BUILTIN_DECK[] = {
+    {"P1", {"FH","FB","DH"}},
+    {"P2", {"DH","FB","RB"}},
+    {"P3", {"DH","FB","FH"}},
+    {"P4", {"DH","DB","FB"}},
+    {"P5", {"DH","RB","DB"}},
+    {"P6", {"RB","FB","RH"}},
+    {"P7", {"FB","RH","FH"}},
+    {"P8", {"RH","DH","RB"}},
+    {"P9", {"FB","DB","DH"}}
+};
+
+static const int CARDS_IN_DECK = sizeof(BUILTIN_DECK)/sizeof(BUILTIN_DECK[0]);
+
+static_assert(sizeof(PRINTORDER) / sizeof(PRINTORDER[0]) == CARDS_IN_DECK,
+              "PRINTORDER and BUILTIN_DECK differ in size");
+
+///////////////////////////////////////////////////////////////////////////////
+
+class Card {
+    public:
+    string mName;
+    vector<string> mEdges;
+
+    Card(string name, vector<string> edges) {
+        mName = name;
+        mEdges = edges;
+    }
+
+    Card(const CardText& text) : mName(text.mName), mEdges(text.mEdges, text.mEdges + EDGES_IN_CARD) {
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct Deck {
+    // BUILTIN_DECK as Cards
+    static const Card* const cards;
+    // Cards drawn by GameState, Deck::cards unless a tool plays another deck
+    // of the same size.
+    static const Card* played;
+};
+
+const Card* const Deck::cards = [] {
+    static const vector<Card> cards(BUILTIN_DECK, BUILTIN_DECK + CARDS_IN_DECK);
+    return cards.data();
+}();
+
+const Card* Deck::played = Deck::cards;
+
+///////////////////////////////////////////////////////////////////////////////
+
+class PlayedCard {
+    public:
+    sint mRotation;
+    sint mPosition;
+    const Card *mCard;
+
+    PlayedCard(const Card *card = NULL, sint position = 0, sint rotation = 0) {
+        mCard = card;
+        mPosition = position;
+        mRotation = rotation;
+    }
+
+    bool matchesNeighbor(PlayedCard *other) {
+        if (mCard == NULL) { return false; }
+        sint common_edge = NEIGHBORMAP[to_string(mPosition)+to_string(other->mPosition)];
+        sint own_rotated_common_edge = (common_edge + mRotation) % EDGES_IN_CARD;
+        sint other_rotated_common_edge = (common_edge + other->mRotation) % EDGES_IN_CARD;
+        string e1 = this->mCard->mEdges[own_rotated_common_edge];
+        string e2 = other->mCard->mEdges[other_rotated_common_edge];
+        if(e1[0] == e2[0] && e1[1] != e2[1] ) {
+            return true;
+        }
+        else {
+            return false;
+        }
+    }
+
+    bool rotate() {
+        if (mRotation >= 2) {
+            return false;
+        }
+        else {
+            mRotation += 1;
+            return true;
+        }
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+class GameState {
+    public:
+    sint mNextOnBoard;
+    sint mTopOfTheDeck;
+    PlayedCard* mCardsOnBoard[CARDS_IN_DECK];
+    
+    GameState() {
+        memset(mCardsOnBoard, 0, sizeof(mCardsOnBoard));
+        mNextOnBoard = mTopOfTheDeck = 0;
+    }
+
+    ~GameState() {
+        for(sint i=0; i<CARDS_IN_DECK; i++) {
+            if(mCardsOnBoard[i]) {
+                delete mCardsOnBoard[i];
+            }
+        }
+    }
+
+    GameState* replicate() {
+        GameState *newstate = new GameState();
+        newstate->mNextOnBoard = this->mNextOnBoard;
+        newstate->mTopOfTheDeck = this->mTopOfTheDeck;
+        for(sint i=0; i<CARDS_IN_DECK; i++) {
+            if(this->mCardsOnBoard[i] == NULL) break;
+            newstate->mCardsOnBoard[i] = 
+            new PlayedCard(
+                this->mCardsOnBoard[i]->mCard,
+                this->mCardsOnBoard[i]->mPosition,
+                this->mCardsOnBoard[i]->mRotation);
+        }
+        return newstate;
+    }
+
+    bool isSolved(bool partial=false) {
+        PlayedCard *c1, *c2;
+        for(const auto& i : NEIGHBORMAP)
+        {
+            string key = i.first;
+            sint n1 = key[0] - '0'; // '1' to 1 etc.
+            sint n2 = key[1] - '0';
+            c1 = mCardsOnBoard[n1];
+            c2 = mCardsOnBoard[n2];
+            if (c1 == NULL || c2 == NULL) {
+                if (partial) {
+                    continue;
+                }
+                else {
+                    return false;
+                }
+            }
+            if (not c1->matchesNeighbor(c2)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void output() {
+        cout << "[";
+        for(sint i=0; i<CARDS_IN_DECK; i++) {
+            cout << mCardsOnBoard[PRINTORDER[i]]->mCard->mName;
+            if (i < CARDS_IN_DECK-1) cout << ",";
+        }
+        cout << "]" << endl;
+    }
+
+    bool isCardOnBoard(const Card* value) {
+        for (sint i=0; i<CARDS_IN_DECK; ++i) {
+            if (mCardsOnBoard[i] != NULL && 
+                mCardsOnBoard[i]->mCard != NULL &&
+                mCardsOnBoard[i]->mCard == value) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const Card* nextFromDeck() {
+        if(mTopOfTheDeck >= CARDS_IN_DECK) {
+            return NULL;
+        }
+        const Card* fromdeck = NULL;
+        for(sint i=mTopOfTheDeck; i<CARDS_IN_DECK; i++) {
+            fromdeck = &Deck::played[i];
+            if(not isCardOnBoard(fromdeck)) {
+                mTopOfTheDeck = i;
+                return fromdeck;
+            }
+
+        }
+        return NULL;
+    }
+
+    bool addNewCard() {
+        const Card *fromdeck = this->nextFromDeck();
+        if(fromdeck == NULL) {
+            return false;
+        }
+        PlayedCard *newcard = new PlayedCard(fromdeck, mNextOnBoard);
+        mCardsOnBoard[newcard->mPosition] = newcard;
+        mNextOnBoard++;
+        return true;
+    }
+
+    bool replaceCard(PlayedCard *card) {
+        const Card *fromdeck = this->nextFromDeck();
+        if(fromdeck == NULL) {
+            return false;
+        }
+        card->mCard = fromdeck;
+        card->mRotation = 0;
+        return true;
+    }
+
+    PlayedCard* getLastAdded() {
+        sint last = mNextOnBoard - 1;
+        return mCardsOnBoard[last];
+    }
+
+    GameState* first() {
+        GameState *newstate = this->replicate();
+        newstate->mTopOfTheDeck = 0;
+        if(!newstate->addNewCard()) {
+            delete newstate;
+            return NULL;
+        }
+        TRACE(TRACE_PLACE, mNextOnBoard, newstate->mTopOfTheDeck, 0);
+        return newstate;
+    }
+
+    GameState* next() {
+        GameState *newstate = this->replicate();
+        PlayedCard *card = newstate->getLastAdded();
+        if (card->rotate()) {
+            TRACE(TRACE_ROTATE, card->mPosition, newstate->mTopOfTheDeck, card->mRotation);
+            return newstate;
+        }
+        else if (!newstate->replaceCard(card)) {
+            delete newstate;
+            return NULL;
+        }
+        TRACE(TRACE_PLACE, card->mPosition, newstate->mTopOfTheDeck, 0);
+        return newstate;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+void solve(GameState* game) {
+    if(!game->isSolved(true)) {
+        TRACE(TRACE_PRUNE, game->mNextOnBoard - 1, game->mTopOfTheDeck,
+              game->getLastAdded()->mRotation);
+        return;
+    }
+
+    if(game->isSolved()) {
+        TRACE(TRACE_SOLUTION, game->mNextOnBoard, 0, 0);
+        game->output();
+    }
+
+    GameState *tempstate = NULL;
+    GameState *newstate = game->first();
+    while(newstate != NULL) {
+        solve(newstate);
+        tempstate = newstate;
+        newstate = newstate->next();
+        delete tempstate;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// BOARD:
+// A triangle of side n has n*n cells in n rows; row r holds 2r+1 cells that
+// alternate between up (even) and down (odd) triangles. An up cell shares
+// its edge 0 with the down cell to its left, edge 1 with the one to its right
+// and edge 2 with the down cell below it, as in the pictures above. Positions
+// are numbered in fill order. The side 3 board is the one of NEIGHBORMAP and
+// PRINTORDER; on other sizes the fill starts from the middle and always
+// continues with the cell that has the most neighbors on the board already.
+
+struct Neighbor {
+    int mPosition;
+    sint mEdge;
+};
+
+class Board {
+    public:
+    int mSide;
+    int mCells;
+    vector<int> mPrintOrder;                // position of each printed cell
+    vector<vector<Neighbor> > mAdjacent;    // all neighbors of a position
+
+    Board(int side) {
+        mSide = side;
+        mCells = side * side;
+        mAdjacent.resize(mCells);
+        if(side == 3) {
+            mPrintOrder.assign(PRINTORDER, PRINTORDER + CARDS_IN_DECK);
+            for(const auto& i : NEIGHBORMAP) {
+                sint n1 = i.first[0] - '0';
+                sint n2 = i.first[1] - '0';
+                mAdjacent[n1].push_back(Neighbor{ n2, i.second });
+                mAdjacent[n2].push_back(Neighbor{ n1, i.second });
+            }
+            return;
+        }
+        // Neighbors by row-major index first.
+        vector<vector<Neighbor> > cells(mCells);
+        for(int r=0; r<side; r++) {
+            for(int k=0; k<=2*r; k++) {
+                int cell = r*r + k;
+                if(k % 2 == 0) {
+                    if(k > 0) cells[cell].push_back(Neighbor{ cell - 1, 0 });
+                    if(k < 2*r) cells[cell].push_back(Neighbor{ cell + 1, 1 });
+                    if(r + 1 < side) cells[cell].push_back(Neighbor{ (r+1)*(r+1) + k + 1, 2 });
+                }
+                else {
+                    cells[cell].push_back(Neighbor{ cell + 1, 0 });
+                    cells[cell].push_back(Neighbor{ cell - 1, 1 });
+                    cells[cell].push_back(Neighbor{ (r-1)*(r-1) + k - 1, 2 });
+                }
+            }
+        }
+        // Distance from the first cell breaks ties in the fill order.
+        int start = (side/2) * (side/2) + side/2;
+        vector<int> distance(mCells, -1);
+        vector<int> queue(1, start);
+        distance[start] = 0;
+        for(size_t i=0; i<queue.size(); i++) {
+            for(const Neighbor& n : cells[queue[i]]) {
+                if(distance[n.mPosition] < 0) {
+                    distance[n.mPosition] = distance[queue[i]] + 1;
+                    queue.push_back(n.mPosition);
+                }
+            }
+        }
+        vector<int> position(mCells, -1), filled(mCells, 0);
+        for(int p=0; p<mCells; p++) {
+            int best = p == 0 ? start : -1;
+            for(int cell=0; p>0 && cell<mCells; cell++) {
+                if(position[cell] >= 0 || filled[cell] == 0) continue;
+                if(best < 0 || filled[cell] > filled[best] ||
+                   (filled[cell] == filled[best] && distance[cell] < distance[best])) {
+                    best = cell;
+                }
+            }
+            position[best] = p;
+            for(const Neighbor& n : cells[best]) filled[n.mPosition]++;
+        }
+        mPrintOrder.resize(mCells);
+        for(int cell=0; cell<mCells; cell++) {
+            mPrintOrder[cell] = position[cell];
+            for(const Neighbor& n : cells[cell]) {
+                mAdjacent[position[cell]].push_back(Neighbor{ position[n.mPosition], n.mEdge });
+            }
+        }
+    }
+
+    // Side of the board for a deck of the given size, 0 if there is none.
+    static int sideFor(int cards) {
+        int side = 1;
+        while(side * side < cards) side++;
+        return side * side == cards ? side : 0;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// FAST ENGINE:
+// The search below does not touch Card strings or NEIGHBORMAP. Edges are
+// encoded as small integers (animal * 2 + head/body) so that two edges match
+// when their codes differ only in the lowest bit, and every position keeps a
+// list of its neighbors that are filled before it. Cards on the board are
+// kept in a 64 bit mask, which bounds the board to side 8.
+
+static const int MAX_SIDE = 8;
+static const int MAX_CARDS = MAX_SIDE * MAX_SIDE;
+// Boards of the local search, which has no masks of cards
+static const int MAX_LOCAL_SIDE = 128;
+static const int MAX_LOCAL_CARDS = MAX_LOCAL_SIDE * MAX_LOCAL_SIDE;
+static const int EDGE_CODES = 2 * 26;      // a head and a body per letter
+
+// Sides of a position in fill order
+enum { SIDE_EARLIER, SIDE_LATER, SIDE_BORDER };
+
+static constexpr sint edgeCode(const char* edge) {
+    return (sint)(((edge[0] - 'A') << 1) | (edge[1] == 'B' ? 1 : 0));
+}
+
+static sint edgeCode(const string& edge) {
+    return edgeCode(edge.c_str());
+}
+
+struct DeckTables {
+    sint mCards;
+    const Card* mDeck;
+    uint64_t mAllCards;     // mask with a bit for every card
+    // Edge code of card c in rotation r at common edge e: mEdge[c][r][e]
+    sint mEdge[MAX_CARDS][EDGES_IN_CARD][EDGES_IN_CARD];
+    // Neighbors of each position that are already on the board
+    sint mNeighbors[MAX_CARDS];
+    sint mNeighborPosition[MAX_CARDS][EDGES_IN_CARD];
+    sint mNeighborEdge[MAX_CARDS][EDGES_IN_CARD];
+    // All neighbors of each position
+    sint mAdjacent[MAX_CARDS];
+    sint mAdjacentPosition[MAX_CARDS][EDGES_IN_CARD];
+    sint mAdjacentEdge[MAX_CARDS][EDGES_IN_CARD];
+    sint mPrintOrder[MAX_CARDS];
+    // What is across edge e of each position
+    sint mSide[MAX_CARDS][EDGES_IN_CARD];
+    // Edges of each code over the whole deck, and how many more internal
+    // edges the deck could pair up than the board has; see balance().
+    sint mSupply[EDGE_CODES];
+    int mBalance;
+    // Cards that show code x at edge e in rotation r: mShowing[r][e][x]
+    uint64_t mShowing[EDGES_IN_CARD][EDGES_IN_CARD][EDGE_CODES];
+    // Cards that may go to position p in rotation r, all of them until
+    // filter() removes some, and in any rotation
+    uint64_t mDomain[MAX_CARDS][EDGES_IN_CARD];
+    uint64_t mAllowed[MAX_CARDS];
+    bool mEmpty;            // filter() found a position or card with no place
+
+    void build(const Card* deck, const Board& board) {
+        memset(this, 0, sizeof(*this));
+        mDeck = deck;
+        mCards = board.mCells;
+        mAllCards = mCards == 64 ? ~0ull : (1ull << mCards) - 1;
+        for(sint c=0; c<mCards; c++) {
+            for(sint r=0; r<EDGES_IN_CARD; r++) {
+                for(sint e=0; e<EDGES_IN_CARD; e++) {
+                    mEdge[c][r][e] = edgeCode(deck[c].mEdges[(e + r) % EDGES_IN_CARD]);
+                }
+            }
+        }
+        sint internal = 0;
+        for(sint p=0; p<mCards; p++) {
+            mPrintOrder[p] = board.mPrintOrder[p];
+            for(sint r=0; r<EDGES_IN_CARD; r++) mDomain[p][r] = mAllCards;
+            mAllowed[p] = mAllCards;
+            for(sint e=0; e<EDGES_IN_CARD; e++) mSide[p][e] = SIDE_BORDER;
+            for(const Neighbor& n : board.mAdjacent[p]) {
+                sint k = mAdjacent[p]++;
+                mAdjacentPosition[p][k] = n.mPosition;
+                mAdjacentEdge[p][k] = n.mEdge;
+                mSide[p][n.mEdge] = n.mPosition < p ? SIDE_EARLIER : SIDE_LATER;
+                if(n.mPosition < p) {
+                    // Kept in fill order, see Search::culprits().
+                    for(k = mNeighbors[p]++; k > 0 && mNeighborPosition[p][k-1] > n.mPosition; k--) {
+                        mNeighborPosition[p][k] = mNeighborPosition[p][k-1];
+                        mNeighborEdge[p][k] = mNeighborEdge[p][k-1];
+                    }
+                    mNeighborPosition[p][k] = n.mPosition;
+                    mNeighborEdge[p][k] = n.mEdge;
+                    internal++;
+                }
+            }
+        }
+        for(sint c=0; c<mCards; c++) {
+            for(sint e=0; e<EDGES_IN_CARD; e++) mSupply[mEdge[c][0][e]]++;
+            for(sint r=0; r<EDGES_IN_CARD; r++) {
+                for(sint e=0; e<EDGES_IN_CARD; e++) {
+                    mShowing[r][e][mEdge[c][r][e]] |= 1ull << c;
+                }
+            }
+        }
+        mBalance = -internal;
+        for(sint a=0; a<EDGE_CODES; a+=2) {
+            mBalance += min(mSupply[a], mSupply[a + 1]);
+        }
+    }
+
+    // Deck of n*n cards, n <= MAX_SIDE, on the triangle of side n.
+    void build(const Card* deck, sint cards) {
+        build(deck, Board(Board::sideFor(cards)));
+    }
+
+    // Every internal edge pairs a head with a body of the same animal, so a
+    // deck with fewer such pairs than the board has internal edges has no
+    // solution, whatever the order of the cards.
+    bool balanced() const {
+        return mBalance >= 0;
+    }
+
+    // False when the deck is known to have no solution.
+    bool feasible() const {
+        return balanced() && !mEmpty;
+    }
+
+    sint domainSize(sint position) const {
+        sint size = 0;
+        for(sint r=0; r<EDGES_IN_CARD; r++) size += __builtin_popcountll(mDomain[position][r]);
+        return size;
+    }
+
+    // Arc consistency: removes the placements that some neighbor has no
+    // placement of another card to match, until every placement left has
+    // one at each neighbor. Returns false if a position or a card is left
+    // with no placement, in which case the deck has no solution.
+    bool filter() {
+        vector<pair<sint, sint> > arcs;             // position, neighbor index
+        vector<array<bool, EDGES_IN_CARD> > queued(mCards);
+        for(sint p=0; p<mCards; p++) {
+            for(sint i=0; i<mAdjacent[p]; i++) {
+                arcs.push_back(make_pair(p, i));
+                queued[p][i] = true;
+            }
+        }
+        while(!arcs.empty()) {
+            sint p = arcs.back().first;
+            sint i = arcs.back().second;
+            arcs.pop_back();
+            queued[p][i] = false;
+            sint q = mAdjacentPosition[p][i];
+            sint e = mAdjacentEdge[p][i];
+            // Cards that can show each code towards p
+            uint64_t support[EDGE_CODES] = {0};
+            for(sint r=0; r<EDGES_IN_CARD; r++) {
+                for(uint64_t left = mDomain[q][r]; left; left &= left - 1) {
+                    sint c = __builtin_ctzll(left);
+                    support[mEdge[c][r][e]] |= 1ull << c;
+                }
+            }
+            bool changed = false;
+            for(sint r=0; r<EDGES_IN_CARD; r++) {
+                for(uint64_t left = mDomain[p][r]; left; left &= left - 1) {
+                    sint c = __builtin_ctzll(left);
+                    if(!(support[mEdge[c][r][e] ^ 1] & ~(1ull << c))) {
+                        mDomain[p][r] &= ~(1ull << c);
+                        changed = true;
+                    }
+                }
+            }
+            if(!changed) continue;
+            mAllowed[p] = mDomain[p][0] | mDomain[p][1] | mDomain[p][2];
+            if(mAllowed[p] == 0) {
+                mEmpty = true;
+                return false;
+            }
+            for(sint k=0; k<mAdjacent[p]; k++) {
+                sint other = mAdjacentPosition[p][k];
+                if(other == q) continue;
+                for(sint j=0; j<mAdjacent[other]; j++) {
+                    if(mAdjacentPosition[other][j] == p && !queued[other][j]) {
+                        arcs.push_back(make_pair(other, j));
+                        queued[other][j] = true;
+                    }
+                }
+            }
+        }
+        uint64_t placed = 0;
+        for(sint p=0; p<mCards; p++) placed |= mAllowed[p];
+        mEmpty = placed != mAllCards;
+        return !mEmpty;
+    }
+
+    // Table version of PlayedCard::matchesNeighbor()
+    bool matches(sint card1, sint rotation1, sint card2, sint rotation2, sint edge) const {
+        return (mEdge[card1][rotation1][edge] ^ mEdge[card2][rotation2][edge]) == 1;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Prefix of a game: cards and rotations on positions 0..mDepth-1.
+struct Task {
+    sint mDepth;
+    double mEstimate;       // estimated boards below the prefix
+    sint mCard[MAX_CARDS];
+    sint mRotation[MAX_CARDS];
+};
+
+// Counters of one worker, written only by that worker and read by the
+// progress thread without locks.
+struct alignas(64) WorkerProgress {
+    atomic<uint64_t> mNodes[MAX_CARDS + 1];    // boards visited per depth
+    atomic<uint64_t> mTasks;                   // tasks finished
+    atomic<double> mDone;                      // estimated nodes of those
+
+    WorkerProgress() {
+        for(auto& n : mNodes) n.store(0);
+        mTasks.store(0);
+        mDone.store(0);
+    }
+};
+
+// Increment of a counter that has a single writer.
+static inline void bump(atomic<uint64_t>& counter, uint64_t by = 1) {
+    counter.store(counter.load(memory_order_relaxed) + by, memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// NOGOODS:
+// Sets of placements that no solution has all of, learned from the dead ends
+// of backjumping. Each is stored under its latest placement together with up
+// to MAX_OTHERS earlier ones, so putting a card on a position only checks the
+// few nogoods that this placement would complete. The slots are a fixed
+// table of 64 bit words that every worker reads and writes without locks; a
+// full bucket overwrites one of its slots.
+//
+// A slot holds the earlier placements in 14 bit fields (position, card and
+// rotation), their number in bits 42-43 and bit 63 to tell it from an empty
+// one.
+
+class NogoodStore {
+    public:
+    static const int SLOTS = 4;             // nogoods per placement
+    static const int MAX_OTHERS = 3;
+    static const size_t BUCKETS = MAX_CARDS * MAX_CARDS * EDGES_IN_CARD;
+    unique_ptr<atomic<uint64_t>[]> mSlots;
+
+    NogoodStore() : mSlots(new atomic<uint64_t>[BUCKETS * SLOTS]) {
+        for(size_t i=0; i<BUCKETS * SLOTS; i++) mSlots[i].store(0, memory_order_relaxed);
+    }
+
+    static size_t bucket(sint position, sint card, sint rotation) {
+        return ((position * MAX_CARDS + card) * EDGES_IN_CARD + rotation) * SLOTS;
+    }
+
+    // Stores the placements of the given positions as a nogood, if it is
+    // small enough.
+    void add(const sint* card, const sint* rotation, uint64_t positions) {
+        if(positions == 0 || __builtin_popcountll(positions) > MAX_OTHERS + 1) return;
+        sint last = 63 - __builtin_clzll(positions);
+        uint64_t entry = 1ull << 63;
+        int n = 0;
+        for(uint64_t rest = positions & ~(1ull << last); rest; rest &= rest - 1) {
+            sint q = __builtin_ctzll(rest);
+            entry |= (uint64_t)(q | card[q] << 6 | rotation[q] << 12) << (14 * n++);
+        }
+        entry |= (uint64_t)n << 42;
+        atomic<uint64_t>* slots = &mSlots[bucket(last, card[last], rotation[last])];
+        for(int i=0; i<SLOTS; i++) {
+            uint64_t seen = slots[i].load(memory_order_relaxed);
+            if(seen == entry) return;
+            if(seen == 0 && slots[i].compare_exchange_strong(seen, entry, memory_order_relaxed)) return;
+        }
+        slots[(entry * 0x9e3779b97f4a7c15ull) >> 62].store(entry, memory_order_relaxed);
+    }
+
+    // Whether the placement completes a nogood with the board before it, and
+    // then the positions of its other placements.
+    bool violated(const sint* card, const sint* rotation, sint position, sint c, sint r,
+                  uint64_t& others) const {
+        const atomic<uint64_t>* slots = &mSlots[bucket(position, c, r)];
+        for(int i=0; i<SLOTS; i++) {
+            uint64_t entry = slots[i].load(memory_order_relaxed);
+            if(entry == 0) continue;
+            int n = (entry >> 42) & 3;
+            others = 0;
+            int k = 0;
+            for(; k<n; k++) {
+                uint64_t field = entry >> (14 * k);
+                sint q = field & 63;
+                if(card[q] != ((field >> 6) & 63) || rotation[q] != ((field >> 12) & 3)) break;
+                others |= 1ull << q;
+            }
+            if(k == n) return true;
+        }
+        return false;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// In-place backtracking over DeckTables. Cards are tried in deck order and
+// rotations from 0 to 2, so solutions come out in the same order as solve().
+// The search ends early when the visitor sets mStopped, after mBudget
+// boards or, checked every CANCEL_CHECK boards, once *mCancel is set by
+// another thread.
+//
+// Boards that the cards left can no longer complete by edge balance are cut
+// off. The slack of an edge code is how many edges of that code the cards
+// left have beyond those the open edges of the board need, and every
+// internal edge still empty needs a head and a body of one animal from the
+// slack. mExcess is how many more such pairs the slack holds than there are
+// empty internal edges; a board is kept while it and every slack are not
+// negative.
+//
+// With mBackjump a dead end jumps back to the latest position that caused it
+// rather than to the previous one. descend() returns the positions that
+// explain why the subtree has no solution: for every card and rotation at a
+// dead end a neighbor that does not match or the position holding the card.
+// A position that is not among those of the subtree below it cannot help, so
+// its other choices are skipped. Below a solution, or a board cut off by
+// balance, every earlier position counts. With mNogoods every such
+// explanation that is small enough is learned, and a placement that
+// completes a learned nogood is dropped like one that does not fit.
+static const uint64_t CANCEL_CHECK = 1024;
+
+class Search {
+    public:
+    const DeckTables* mTables;
+    sint mLimit;
+    uint64_t mUsed;
+    sint mCard[MAX_CARDS];
+    sint mRotation[MAX_CARDS];
+    WorkerProgress* mProgress;
+    uint64_t mBudget;
+    bool mStopped;
+    int mSlack[EDGE_CODES];
+    int mExcess;
+    bool mBackjump;
+    NogoodStore* mNogoods;
+    uint64_t mFound;        // boards given to the visitor
+    const atomic<bool>* mCancel;
+
+    Search(const DeckTables* tables, WorkerProgress* progress = NULL) {
+        mTables = tables;
+        mLimit = tables->mCards;
+        mUsed = 0;
+        memset(mCard, 0, sizeof(mCard));
+        memset(mRotation, 0, sizeof(mRotation));
+        mProgress = progress;
+        mBudget = ~0ull;
+        mStopped = false;
+        mBackjump = true;
+        mNogoods = NULL;
+        mFound = 0;
+        mCancel = NULL;
+        rebalance(0);
+    }
+
+    void restore(const Task& task) {
+        mUsed = 0;
+        for(sint i=0; i<task.mDepth; i++) {
+            mCard[i] = task.mCard[i];
+            mRotation[i] = task.mRotation[i];
+            mUsed |= 1ull << task.mCard[i];
+        }
+        rebalance(task.mDepth);
+    }
+
+    // Slack and excess of the board filled up to depth.
+    void rebalance(sint depth) {
+        for(sint x=0; x<EDGE_CODES; x++) mSlack[x] = mTables->mSupply[x];
+        mExcess = mTables->mBalance;
+        for(sint p=0; p<depth; p++) {
+            balance(p, mCard[p], mRotation[p]);
+        }
+    }
+
+    // Updates the slack for a card put on the board and returns whether the
+    // board can still balance. An edge towards an earlier position is the one
+    // that position needed, and one towards a later position takes a pair
+    // of slack for an internal edge that is no longer empty, so only border
+    // edges can lower the excess.
+    bool balance(sint position, sint card, sint rotation) {
+        const DeckTables& t = *mTables;
+        bool ok = true;
+        for(sint e=0; e<EDGES_IN_CARD; e++) {
+            sint x = t.mEdge[card][rotation][e];
+            if(t.mSide[position][e] == SIDE_LATER) {
+                ok &= --mSlack[x] >= 0;
+                ok &= --mSlack[x ^ 1] >= 0;
+            }
+            else if(t.mSide[position][e] == SIDE_BORDER) {
+                if(mSlack[x] <= mSlack[x ^ 1]) mExcess--;
+                ok &= --mSlack[x] >= 0;
+            }
+        }
+        return ok && mExcess >= 0;
+    }
+
+    // Undoes balance().
+    void unbalance(sint position, sint card, sint rotation) {
+        const DeckTables& t = *mTables;
+        for(sint e=EDGES_IN_CARD; e-- > 0;) {
+            sint x = t.mEdge[card][rotation][e];
+            if(t.mSide[position][e] == SIDE_LATER) {
+                mSlack[x]++;
+                mSlack[x ^ 1]++;
+            }
+            else if(t.mSide[position][e] == SIDE_BORDER) {
+                mSlack[x]++;
+                if(mSlack[x] <= mSlack[x ^ 1]) mExcess++;
+            }
+        }
+    }
+
+    // Positions filled before this one, as a mask.
+    static uint64_t earlier(sint position) {
+        return position >= 64 ? ~0ull : (1ull << position) - 1;
+    }
+
+    // Adds why no card fits the position besides those whose subtrees were
+    // searched: for every rotation the earliest neighbor that a card does
+    // not match, and the position holding a card that would fit.
+    uint64_t culprits(sint position, uint64_t culprits) const {
+        const DeckTables& t = *mTables;
+        uint64_t fitting = 0;
+        for(sint r=0; r<EDGES_IN_CARD; r++) {
+            uint64_t left = t.mDomain[position][r];
+            for(sint i=0; i<t.mNeighbors[position]; i++) {
+                sint other = t.mNeighborPosition[position][i];
+                sint e = t.mNeighborEdge[position][i];
+                uint64_t shows = t.mShowing[r][e][t.mEdge[mCard[other]][mRotation[other]][e] ^ 1];
+                if(left & ~shows) culprits |= 1ull << other;
+                left &= shows;
+            }
+            fitting |= left;
+        }
+        fitting &= mUsed;
+        for(sint q=0; fitting; q++) {
+            if(fitting & (1ull << mCard[q])) {
+                culprits |= 1ull << q;
+                fitting &= ~(1ull << mCard[q]);
+            }
+        }
+        return culprits;
+    }
+
+    bool fits(sint position, sint card, sint rotation) const {
+        const DeckTables& t = *mTables;
+        if(!(t.mDomain[position][rotation] & (1ull << card))) {
+            return false;
+        }
+        for(sint i=0; i<t.mNeighbors[position]; i++) {
+            sint other = t.mNeighborPosition[position][i];
+            if(!t.matches(card, rotation, mCard[other], mRotation[other],
+                          t.mNeighborEdge[position][i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Table version of GameState::isSolved() for a full board.
+    bool isSolved() const {
+        for(sint p=1; p<mTables->mCards; p++) {
+            if(!fits(p, mCard[p], mRotation[p])) return false;
+        }
+        return true;
+    }
+
+    // Table version of GameState::nextFromDeck(): first card from the given
+    // one on that is not on the board, or mCards if there is none.
+    sint nextFree(sint from) const {
+        if(from >= 64) return mTables->mCards;
+        uint64_t free = ~mUsed & (~0ull << from) & mTables->mAllCards;
+        return free ? __builtin_ctzll(free) : mTables->mCards;
+    }
+
+    // Calls visitor(*this) for every valid board filled up to mLimit.
+    template<class Visitor>
+    void solve(sint position, Visitor& visitor) {
+        if(mBackjump) descend<true>(position, visitor);
+        else descend<false>(position, visitor);
+    }
+
+    // Returns the positions before this one that the subtree depends on.
+    template<bool Backjump, class Visitor>
+    uint64_t descend(sint position, Visitor& visitor) {
+        uint64_t all = earlier(position);
+        if(mBudget == 0) {
+            mStopped = true;
+            return all;
+        }
+        mBudget--;
+        if(mCancel && mBudget % CANCEL_CHECK == 0 && mCancel->load(memory_order_relaxed)) {
+            mStopped = true;
+            return all;
+        }
+        if(mProgress) {
+            bump(mProgress->mNodes[position]);
+        }
+        if(position == 0 && !mTables->feasible()) {
+            return all;
+        }
+        if(position == mLimit) {
+            if(position == mTables->mCards) {
+                TRACE(TRACE_SOLUTION, position, 0, 0);
+            }
+            mFound++;
+            visitor(*this);
+            return all;
+        }
+        uint64_t self = 1ull << position;
+        uint64_t conflicts = 0;
+        uint64_t found = mFound;
+        for(uint64_t left = mTables->mAllowed[position] & ~mUsed; left && !mStopped; left &= left - 1) {
+            sint c = __builtin_ctzll(left);
+            mUsed |= 1ull << c;
+            mCard[position] = c;
+            for(sint r=0; r<EDGES_IN_CARD && !mStopped; r++) {
+                TRACE(r == 0 ? TRACE_PLACE : TRACE_ROTATE, position, c, r);
+                uint64_t others;
+                if(!fits(position, c, r)) {
+                    TRACE(TRACE_PRUNE, position, c, r);
+                }
+                else if(Backjump && mNogoods &&
+                        mNogoods->violated(mCard, mRotation, position, c, r, others)) {
+                    TRACE(TRACE_PRUNE, position, c, r);
+                    conflicts |= others;
+                }
+                else {
+                    mRotation[position] = r;
+                    if(balance(position, c, r)) {
+                        uint64_t below = descend<Backjump>(position + 1, visitor);
+                        if(Backjump && !(below & self)) {
+                            unbalance(position, c, r);
+                            mUsed &= ~(1ull << c);
+                            return below;
+                        }
+                        conflicts |= below & ~self;
+                    }
+                    else {
+                        TRACE(TRACE_PRUNE, position, c, r);
+                        conflicts = all;
+                    }
+                    unbalance(position, c, r);
+                }
+            }
+            mUsed &= ~(1ull << c);
+        }
+        if(!Backjump || mStopped) {
+            return all;
+        }
+        if(conflicts != all) {
+            conflicts = culprits(position, conflicts);
+            if(position > 1 && !(conflicts & (self >> 1))) {
+                TRACE(TRACE_BACKJUMP, position, 63 - __builtin_clzll(conflicts), 0);
+            }
+        }
+        if(mNogoods && mFound == found) {
+            mNogoods->add(mCard, mRotation, conflicts);
+        }
+        return conflicts;
+    }
+
+    // Knuth's estimate of the number of boards below the current one: walk
+    // down a random path and multiply the number of choices at each level.
+    // The product is also an estimate of the solutions below if the path
+    // fills the board, and zero if it does not; that goes to *solutions.
+    template<class Random>
+    double probe(sint position, Random& random, double* solutions = NULL) {
+        uint64_t used = mUsed;
+        double width = 1, nodes = 1;
+        if(solutions) *solutions = position == mTables->mCards ? 1 : 0;
+        sint card[MAX_CARDS * EDGES_IN_CARD], rotation[MAX_CARDS * EDGES_IN_CARD];
+        for(sint p=position; p<mTables->mCards; p++) {
+            int choices = 0;
+            for(sint c=nextFree(0); c<mTables->mCards; c=nextFree(c + 1)) {
+                for(sint r=0; r<EDGES_IN_CARD; r++) {
+                    if(fits(p, c, r)) {
+                        card[choices] = c;
+                        rotation[choices] = r;
+                        choices++;
+                    }
+                }
+            }
+            if(choices == 0) break;
+            width *= choices;
+            nodes += width;
+            int pick = uniform_int_distribution<int>(0, choices - 1)(random);
+            mCard[p] = card[pick];
+            mRotation[p] = rotation[pick];
+            mUsed |= 1ull << card[pick];
+            if(p == mTables->mCards - 1 && solutions) *solutions = width;
+        }
+        mUsed = used;
+        return nodes;
+    }
+
+    void output(ostream& out) const {
+        out << "[";
+        for(sint i=0; i<mTables->mCards; i++) {
+            out << mTables->mDeck[mCard[mTables->mPrintOrder[i]]].mName;
+            if (i < mTables->mCards-1) out << ",";
+        }
+        out << "]" << endl;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// NUMA:
+// Nodes and their cpus are read from sysfs, restricted to the cpus this
+// process may run on. Without sysfs (or outside Linux) every cpu is put on a
+// single node.
+
+class NumaTopology {
+    public:
+    vector<vector<int> > mNodeCpus;
+
+    static vector<int> parseCpuList(const string& list) {
+        vector<int> cpus;
+        size_t i = 0;
+        while(i < list.size()) {
+            size_t end = list.find(',', i);
+            if(end == string::npos) end = list.size();
+            string range = list.substr(i, end - i);
+            size_t dash = range.find('-');
+            if(!range.empty() && range[0] >= '0' && range[0] <= '9') {
+                int lo = atoi(range.c_str());
+                int hi = dash == string::npos ? lo : atoi(range.c_str() + dash + 1);
+                for(int c=lo; c<=hi; c++) cpus.push_back(c);
+            }
+            i = end + 1;
+        }
+        return cpus;
+    }
+
+    void discover() {
+        mNodeCpus.clear();
+        vector<int> allowed;
+#ifdef __linux__
+        cpu_set_t set;
+        if(sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for(int c=0; c<CPU_SETSIZE; c++) {
+                if(CPU_ISSET(c, &set)) allowed.push_back(c);
+            }
+        }
+        for(int node=0; ; node++) {
+            ifstream in("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+            if(!in) break;
+            string list;
+            getline(in, list);
+            vector<int> cpus;
+            for(int c : parseCpuList(list)) {
+                if(find(allowed.begin(), allowed.end(), c) != allowed.end()) {
+                    cpus.push_back(c);
+                }
+            }
+            if(!cpus.empty()) mNodeCpus.push_back(cpus);
+        }
+#endif
+        if(mNodeCpus.empty()) {
+            if(allowed.empty()) {
+                int n = max(1u, thread::hardware_concurrency());
+                for(int c=0; c<n; c++) allowed.push_back(c);
+            }
+            mNodeCpus.push_back(allowed);
+        }
+    }
+
+    static bool pin(const vector<int>& cpus) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(int c : cpus) CPU_SET(c, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        return false;
+#endif
+    }
+
+    // Copy of the tables in memory first touched by a thread running on the
+    // given node, so the pages are allocated from that node. NULL if that
+    // cannot be done; the workers of the node then share the original.
+    DeckTables* replicate(const DeckTables& tables, int node) const {
+#ifdef __linux__
+        cpu_set_t saved;
+        pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved);
+        pin(mNodeCpus[node]);
+        void* p = mmap(NULL, sizeof(DeckTables), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        DeckTables* copy = NULL;
+        if(p != MAP_FAILED) {
+            copy = static_cast<DeckTables*>(p);
+            memcpy(copy, &tables, sizeof(DeckTables));
+        }
+        pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+        return copy;
+#else
+        return NULL;
+#endif
+    }
+
+    // Frees a copy made by replicate().
+    static void release(DeckTables* tables) {
+#ifdef __linux__
+        munmap(tables, sizeof(DeckTables));
+#endif
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// PARALLEL:
+// The top of the search tree is expanded into Tasks that are dealt to the
+// workers' queues. A worker pops from the front of its own queue and, once
+// that is empty, steals from the back of the other queues: first from
+// workers on its own node, then from the rest. A single worker thus finds
+// the solutions in the same order as solve(). With numa enabled every worker
+// is pinned to one core and reads the copy of the tables on its own node.
+
+struct alignas(64) WorkerQueue {
+    mutex mLock;
+    deque<Task> mTasks;
+};
+
+class ParallelSolver {
+    public:
+    const DeckTables* mTables;
+    int mThreads;
+    bool mNuma;
+    NumaTopology mTopology;
+    vector<int> mWorkerNode;
+    vector<int> mWorkerCpu;
+    vector<DeckTables*> mNodeTables;
+    vector<WorkerQueue> mQueues;
+    mutex mOutputLock;
+    // Called for every solution under mOutputLock, prints it by default.
+    function<void(const Search&)> mOnSolution;
+    // Called instead when set, on the worker's own thread with its index and
+    // without the lock, for callers that keep per-worker state.
+    function<void(int, const Search&)> mOnWorkerSolution;
+    // Nogoods shared by the workers, none by default
+    NogoodStore* mNogoods;
+    // Ends the search early once set, see Search::mCancel
+    const atomic<bool>* mCancel;
+
+    // Progress reporting, see watch()
+    double mInterval;
+    bool mCountNodes;       // count visited boards without reporting them
+    string mStatusPath;
+    vector<WorkerProgress> mProgress;
+    size_t mTotalTasks;
+    double mTotalEstimate;
+    chrono::steady_clock::time_point mStart;
+    mutex mWatchLock;
+    condition_variable mWatchWake;
+    bool mFinished;
+
+    ParallelSolver(const DeckTables* tables, int threads, bool numa,
+                   double interval = 0, const string& statusPath = "")
+        : mQueues(threads), mProgress(threads) {
+        mTables = tables;
+        mThreads = threads;
+        mNuma = numa;
+        mInterval = interval;
+        mCountNodes = false;
+        mStatusPath = statusPath;
+        mTotalTasks = 0;
+        mTotalEstimate = 0;
+        mFinished = false;
+        mOnSolution = [](const Search& s) { s.output(cout); };
+        mNogoods = NULL;
+        mCancel = NULL;
+        if(mNuma) {
+            mTopology.discover();
+        }
+        else {
+            mTopology.mNodeCpus.assign(1, vector<int>());
+        }
+        // Spread the workers evenly over the nodes.
+        int nodes = mTopology.mNodeCpus.size();
+        for(int w=0; w<threads; w++) {
+            int node = w % nodes;
+            const vector<int>& cpus = mTopology.mNodeCpus[node];
+            mWorkerNode.push_back(node);
+            mWorkerCpu.push_back(cpus.empty() ? -1 : cpus[(w / nodes) % cpus.size()]);
+        }
+        for(int node=0; node<nodes; node++) {
+            mNodeTables.push_back(mNuma ? mTopology.replicate(*tables, node) : NULL);
+        }
+    }
+
+    ~ParallelSolver() {
+        for(DeckTables* t : mNodeTables) {
+            if(t) NumaTopology::release(t);
+        }
+    }
+
+    static const int PROBES = 16;
+
+    // Expands the tree until there are at least wanted tasks or the boards
+    // are full.
+    static vector<Task> expand(const DeckTables* tables, size_t wanted) {
+        vector<Task> tasks(1);
+        tasks[0].mDepth = 0;
+        for(sint depth=1; depth<=tables->mCards && tasks.size() < wanted; depth++) {
+            vector<Task> deeper;
+            for(const Task& task : tasks) {
+                Search search(tables);
+                search.restore(task);
+                search.mLimit = depth;
+                auto collect = [&](Search& s) {
+                    Task t;
+                    t.mDepth = depth;
+                    t.mEstimate = 0;    // split() sets it when there is an interval
+                    memcpy(t.mCard, s.mCard, depth);
+                    memcpy(t.mRotation, s.mRotation, depth);
+                    deeper.push_back(t);
+                };
+                search.solve(task.mDepth, collect);
+            }
+            tasks.swap(deeper);
+        }
+        return tasks;
+    }
+
+    // Enough tasks to keep every worker busy while leaving room for
+    // stealing.
+    void split() {
+        vector<Task> tasks = expand(mTables, 16 * mThreads);
+        mTotalTasks = tasks.size();
+        if(mInterval > 0) {
+            mt19937 random(1);
+            for(Task& task : tasks) {
+                Search search(mTables);
+                search.restore(task);
+                double sum = 0;
+                for(int i=0; i<PROBES; i++) {
+                    sum += search.probe(task.mDepth, random);
+                }
+                task.mEstimate = sum / PROBES;
+                mTotalEstimate += task.mEstimate;
+            }
+        }
+        for(size_t i=0; i<tasks.size(); i++) {
+            mQueues[i % mThreads].mTasks.push_back(tasks[i]);
+        }
+    }
+
+    bool take(int worker, Task& task) {
+        WorkerQueue& own = mQueues[worker];
+        {
+            lock_guard<mutex> lock(own.mLock);
+            if(!own.mTasks.empty()) {
+                task = own.mTasks.front();
+                own.mTasks.pop_front();
+                return true;
+            }
+        }
+        for(int pass=0; pass<2; pass++) {
+            for(int i=1; i<mThreads; i++) {
+                int victim = (worker + i) % mThreads;
+                bool local = mWorkerNode[victim] == mWorkerNode[worker];
+                if(local != (pass == 0)) continue;
+                WorkerQueue& queue = mQueues[victim];
+                lock_guard<mutex> lock(queue.mLock);
+                if(!queue.mTasks.empty()) {
+                    task = queue.mTasks.back();
+                    queue.mTasks.pop_back();
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void work(int worker) {
+        if(mNuma && mWorkerCpu[worker] >= 0) {
+            NumaTopology::pin(vector<int>(1, mWorkerCpu[worker]));
+        }
+        const DeckTables* tables = mNuma && mNodeTables[mWorkerNode[worker]] ?
+            mNodeTables[mWorkerNode[worker]] : mTables;
+        auto report = [&](Search& s) {
+            if(mOnWorkerSolution) {
+                mOnWorkerSolution(worker, s);
+                return;
+            }
+            lock_guard<mutex> lock(mOutputLock);
+            mOnSolution(s);
+        };
+        WorkerProgress* progress = mInterval > 0 || mCountNodes ? &mProgress[worker] : NULL;
+        Task task;
+        while(take(worker, task)) {
+            if(mCancel && mCancel->load()) {
+                continue;
+            }
+            Search search(tables, progress);
+            search.restore(task);
+            search.mNogoods = mNogoods;
+            search.mCancel = mCancel;
+            if(task.mDepth == tables->mCards) {
+                report(search);
+            }
+            else {
+                search.solve(task.mDepth, report);
+            }
+            if(progress) {
+                bump(progress->mTasks);
+                progress->mDone.store(progress->mDone.load(memory_order_relaxed) +
+                                      task.mEstimate, memory_order_relaxed);
+            }
+        }
+    }
+
+    // PROGRESS:
+    // Every mInterval seconds the watching thread sums the workers' counters
+    // and reports the search rate, the nodes visited per depth since the last
+    // report, the finished share of the tasks the tree was split into and the
+    // time left. The share and the time left are weighted by the estimated
+    // subtree size of every task, see Search::probe().
+    void report(double elapsed, double seconds, uint64_t nodes, uint64_t lastNodes,
+                const vector<uint64_t>& depth, const vector<uint64_t>& lastDepth) {
+        uint64_t tasks = 0;
+        double done = 0;
+        for(const WorkerProgress& p : mProgress) {
+            tasks += p.mTasks.load(memory_order_relaxed);
+            done += p.mDone.load(memory_order_relaxed);
+        }
+        double fraction = tasks == mTotalTasks ? 1 :
+                          mTotalEstimate > 0 ? min(done / mTotalEstimate, 1.0) : 0;
+        ostringstream line;
+        line << fixed << setprecision(1)
+             << "progress: " << elapsed << "s"
+             << " nodes=" << nodes
+             << " rate=" << (seconds > 0 ? (nodes - lastNodes) / seconds : 0) << "/s"
+             << " branches=" << tasks << "/" << mTotalTasks
+             << " done=" << 100 * fraction << "%";
+        if(fraction > 0) {
+            line << " eta=" << elapsed * (1 - fraction) / fraction << "s";
+        }
+        else {
+            line << " eta=?";
+        }
+        line << " depth=";
+        for(size_t d=0; d<depth.size(); d++) {
+            line << (d ? "," : "") << depth[d] - lastDepth[d];
+        }
+        line << endl;
+        if(mStatusPath.empty()) {
+            cerr << line.str();
+        }
+        else {
+            // Replace the file in one step so readers never see half a line.
+            string temp = mStatusPath + ".tmp";
+            ofstream out(temp.c_str());
+            out << line.str();
+            out.close();
+            rename(temp.c_str(), mStatusPath.c_str());
+        }
+    }
+
+    void watch() {
+        vector<uint64_t> depth(mTables->mCards + 1), lastDepth(depth.size());
+        uint64_t lastNodes = 0;
+        auto last = mStart;
+        unique_lock<mutex> lock(mWatchLock);
+        bool finished = false;
+        while(!finished) {
+            finished = mWatchWake.wait_for(lock, chrono::duration<double>(mInterval),
+                                           [this] { return mFinished; });
+            uint64_t nodes = 0;
+            fill(depth.begin(), depth.end(), 0);
+            for(const WorkerProgress& p : mProgress) {
+                for(size_t d=0; d<depth.size(); d++) {
+                    uint64_t n = p.mNodes[d].load(memory_order_relaxed);
+                    depth[d] += n;
+                    nodes += n;
+                }
+            }
+            auto now = chrono::steady_clock::now();
+            report(chrono::duration<double>(now - mStart).count(),
+                   chrono::duration<double>(now - last).count(),
+                   nodes, lastNodes, depth, lastDepth);
+            last = now;
+            lastNodes = nodes;
+            lastDepth = depth;
+        }
+    }
+
+    void solve() {
+        mStart = chrono::steady_clock::now();
+        split();
+        thread watcher;
+        if(mInterval > 0) {
+            watcher = thread(&ParallelSolver::watch, this);
+        }
+        vector<thread> workers;
+        for(int w=0; w<mThreads; w++) {
+            workers.push_back(thread(&ParallelSolver::work, this, w));
+        }
+        for(thread& t : workers) {
+            t.join();
+        }
+        if(watcher.joinable()) {
+            {
+                lock_guard<mutex> lock(mWatchLock);
+                mFinished = true;
+            }
+            mWatchWake.notify_one();
+            watcher.join();
+        }
+    }
+
+    // Boards the workers visited, with mCountNodes or progress reports on.
+    uint64_t nodes() const {
+        uint64_t total = 0;
+        for(const WorkerProgress& p : mProgress) {
+            for(const auto& n : p.mNodes) total += n.load(memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+
+// GENERATOR:
+// Random decks for a board of the given side. A planted deck is cut from a random
+// board whose internal edges all match, so it has at least one solution;
+// otherwise every edge is drawn independently. Cards are shuffled and turned
+// to a random rotation either way.
+
+static const char ANIMALS[] = "FDRACEGIJKLMNOPQSTUVWXYZ";
+
+// Inverse of edgeCode()
+static string edgeName(sint code) {
+    string name;
+    name += (char)('A' + (code >> 1));
+    name += (code & 1) ? 'B' : 'H';
+    return name;
+}
+
+template<class Random>
+vector<Card> generateDeck(Random& random, int animals, bool planted, int side = 3) {
+    Board board(side);
+    uniform_int_distribution<int> symbol(0, 2 * animals - 1);
+    vector<array<sint, EDGES_IN_CARD> > edges(board.mCells);
+    for(int p=0; p<board.mCells; p++) {
+        for(int e=0; e<EDGES_IN_CARD; e++) {
+            int s = symbol(random);
+            edges[p][e] = ((ANIMALS[s >> 1] - 'A') << 1) | (s & 1);
+        }
+    }
+    if(planted) {
+        for(int p=0; p<board.mCells; p++) {
+            for(const Neighbor& n : board.mAdjacent[p]) {
+                if(n.mPosition < p) {
+                    edges[p][n.mEdge] = edges[n.mPosition][n.mEdge] ^ 1;
+                }
+            }
+        }
+    }
+    vector<int> order(board.mCells);
+    for(int p=0; p<board.mCells; p++) order[p] = p;
+    shuffle(order.begin(), order.end(), random);
+    vector<Card> deck;
+    uniform_int_distribution<int> rotation(0, EDGES_IN_CARD - 1);
+    for(int i=0; i<board.mCells; i++) {
+        int r = rotation(random);
+        vector<string> names(EDGES_IN_CARD);
+        for(int e=0; e<EDGES_IN_CARD; e++) {
+            names[(e + r) % EDGES_IN_CARD] = edgeName(edges[order[i]][e]);
+        }
+        deck.push_back(Card("P" + to_string(i + 1), names));
+    }
+    return deck;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// DECK FILES:
+// A card per line: name and edges, e.g. "P1 FH FB DH". This is also what
+// megakolmio.c and megakolmio.py read when given a deck file. Edges are an
+// animal letter A-Z followed by H (head) or B (body). Blank lines and lines
+// starting with # are skipped. A deck of n*n cards is played on the triangle
+// of side n, up to MAX_SIDE, or to MAX_LOCAL_SIDE for the local search.
+
+static const size_t MAX_NAME = 16;
+static const size_t MAX_LINE = 256;
+
+inline void writeDeck(ostream& out, const vector<Card>& deck) {
+    for(const Card& card : deck) {
+        out << card.mName;
+        for(const string& edge : card.mEdges) out << " " << edge;
+        out << "\n";
+    }
+}
+
+// Reads a deck, or returns false with the reason and the line in error.
+// Anything may come in here, so every field is checked before it is used.
+inline bool readDeck(istream& in, vector<Card>& deck, string& error,
+                     size_t maxCards = MAX_CARDS) {
+    deck.clear();
+    string line;
+    int number = 0;
+    unordered_map<string, size_t> names;
+    while(getline(in, line)) {
+        number++;
+        string where = "line " + to_string(number) + ": ";
+        if(line.size() > MAX_LINE) {
+            error = where + "too long";
+            return false;
+        }
+        istringstream fields(line);
+        string name, edge;
+        if(!(fields >> name) || name[0] == '#') continue;
+        if(name.size() > MAX_NAME) {
+            error = where + "card name too long";
+            return false;
+        }
+        for(char c : name) {
+            if(c <= ' ' || c > '~' || c == ',' || c == ':' ||
+               c == '[' || c == ']') {
+                error = where + "bad character in card name";
+                return false;
+            }
+        }
+        if(!names.insert(make_pair(name, deck.size())).second) {
+            error = where + "card " + name + " appears twice";
+            return false;
+        }
+        vector<string> edges;
+        while(fields >> edge) {
+            if(edge.size() != 2 || edge[0] < 'A' || edge[0] > 'Z' ||
+               (edge[1] != 'H' && edge[1] != 'B')) {
+                error = where + "bad edge " + edge.substr(0, 8);
+                return false;
+            }
+            edges.push_back(edge);
+        }
+        if(edges.size() != EDGES_IN_CARD) {
+            error = where + "a card needs " + to_string(EDGES_IN_CARD) + " edges";
+            return false;
+        }
+        if(deck.size() == maxCards) {
+            error = where + "more than " + to_string(maxCards) + " cards";
+            return false;
+        }
+        deck.push_back(Card(name, edges));
+    }
+    if(deck.empty() || Board::sideFor(deck.size()) == 0) {
+        error = to_string(deck.size()) + " cards do not fill a triangle";
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
@@ -65,7 +65,7 @@ PRINTORDER = [6,2,0,1,7,3,4,5,8]
 
 class Deck:
     # Deck of cards: each card has a name and three edges
-    def __init__(self):
+    def __init__(self, path=None):
         # F = Fox, D = Deer, R = Raccoon
         # H = Head, B = Body
         self.cards = []
@@ -78,6 +78,14 @@ class Deck:
         self.cards.append(Card("P7",["FB","RH","FH"]))
         self.cards.append(Card("P8",["RH","DH","RB"]))
         self.cards.append(Card("P9",["FB","DB","DH"]))
+        if path:
+            # A card per line: name and edges, e.g. "P1 FH FB DH". Blank
+            # lines and lines starting with # are skipped.
+            self.cards = []
+            for line in open(path):
+                fields = line.split()
+                if fields and not fields[0].startswith("#"):
+                    self.cards.append(Card(fields[0],fields[1:]))
         self.nCardsInDeck = len(self.cards)
 
 ################################################################################
@@ -253,7 +261,7 @@ def solve(game):
 ################################################################################
 
 if __name__ == "__main__":
-    DECK = Deck()
+    DECK = Deck(sys.argv[1] if len(sys.argv) > 1 else None)
     game = GameState()
     solve(game)
 
@@ -0,0 +1,344 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#include "megakolmio.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+// BENCHMARK:
+// Runs the engines over the built-in deck and a set of generated decks and
+// reports wall time per deck and per visited board. The reference engine
+// skips the decks of bigger boards. Solutions are written to
+// a stream that only counts lines, so every engine pays the same output cost.
+// With --perf the Linux perf_event counters of the process (including worker
+// threads) are read around each run.
+
+class LineCounter : public streambuf {
+    public:
+    uint64_t mLines;
+
+    LineCounter() {
+        mLines = 0;
+    }
+
+    int overflow(int c) {
+        if(c == '\n') mLines++;
+        return c;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+class PerfCounters {
+    public:
+    struct Event {
+        const char* mName;
+        uint32_t mType;
+        uint64_t mConfig;
+        int mFd;
+        uint64_t mValue;
+    };
+    vector<Event> mEvents;
+
+    enum { CYCLES, INSTRUCTIONS, BRANCH_MISSES, L1_MISSES, LLC_MISSES };
+
+    PerfCounters() {
+#ifdef __linux__
+        const uint64_t readMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        mEvents = {
+            { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1, 0 },
+            { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1, 0 },
+            { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1, 0 },
+            { "l1d-misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | readMiss, -1, 0 },
+            { "llc-misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | readMiss, -1, 0 },
+        };
+#endif
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for(Event& e : mEvents) {
+            if(e.mFd >= 0) close(e.mFd);
+        }
+#endif
+    }
+
+    // Returns false if none of the counters can be opened, typically because
+    // of kernel.perf_event_paranoid or a missing PMU in a virtual machine.
+    bool open() {
+        bool any = false;
+#ifdef __linux__
+        for(Event& e : mEvents) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = e.mType;
+            attr.config = e.mConfig;
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            e.mFd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            any = any || e.mFd >= 0;
+        }
+#endif
+        return any;
+    }
+
+    void start() {
+#ifdef __linux__
+        for(Event& e : mEvents) {
+            if(e.mFd < 0) continue;
+            ioctl(e.mFd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(e.mFd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+        for(Event& e : mEvents) {
+            if(e.mFd < 0) continue;
+            ioctl(e.mFd, PERF_EVENT_IOC_DISABLE, 0);
+            if(read(e.mFd, &e.mValue, sizeof(e.mValue)) != sizeof(e.mValue)) {
+                e.mValue = 0;
+            }
+        }
+#endif
+    }
+
+    bool has(int event) const {
+        return event < (int)mEvents.size() && mEvents[event].mFd >= 0;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct Result {
+    uint64_t mSolutions;
+    uint64_t mNodes;
+    double mSeconds;
+    vector<uint64_t> mCounters;
+};
+
+static const char* const ENGINES[] = { "reference", "fast", "parallel" };
+
+// Besides the 3 by 3 decks a planted deck of every side up to
+// MAX_BENCH_SIDE, with 2*side-2 animals as in megakolmio_diff, gives the
+// parallel engine enough work to measure more than its setup.
+static const int MAX_BENCH_SIDE = 5;
+
+// solve() of the reference engine, counting the boards it visits.
+static void solveCounting(GameState* game, uint64_t& nodes) {
+    nodes++;
+    if(!game->isSolved(true)) return;
+    if(game->isSolved()) game->output();
+    GameState* newstate = game->first();
+    while(newstate != NULL) {
+        solveCounting(newstate, nodes);
+        GameState* tempstate = newstate;
+        newstate = newstate->next();
+        delete tempstate;
+    }
+}
+
+// Runs the engine and returns the boards it visited. Every engine prunes
+// differently, so each one counts its own. The parallel engine runs the
+// solver it is given, which is built before the clock starts.
+static uint64_t runEngine(const string& engine, const vector<Card>& deck,
+                          const DeckTables& tables, ParallelSolver* solver) {
+    uint64_t nodes = 0;
+    if(engine == "reference") {
+        Deck::played = deck.data();
+        GameState* game = new GameState();
+        solveCounting(game, nodes);
+        delete game;
+        Deck::played = Deck::cards;
+    }
+    else if(engine == "fast") {
+        WorkerProgress progress;
+        Search search(&tables, &progress);
+        auto report = [](Search& s) { s.output(cout); };
+        search.solve(0, report);
+        for(const auto& n : progress.mNodes) nodes += n.load();
+    }
+    else {
+        solver->solve();
+        nodes = solver->nodes();
+    }
+    return nodes;
+}
+
+static Result measure(const string& engine, const vector<Card>& deck,
+                      const DeckTables& tables, int threads,
+                      PerfCounters* perf, int repeat) {
+    Result best;
+    best.mSeconds = -1;
+    for(int i=0; i<repeat; i++) {
+        // Replicating the tables and setting up the workers is not timed.
+        unique_ptr<ParallelSolver> solver;
+        if(engine == "parallel") {
+            solver.reset(new ParallelSolver(&tables, threads, true));
+            solver->mCountNodes = true;
+        }
+        LineCounter lines;
+        streambuf* saved = cout.rdbuf(&lines);
+        if(perf) perf->start();
+        auto start = chrono::steady_clock::now();
+        uint64_t nodes = runEngine(engine, deck, tables, solver.get());
+        auto end = chrono::steady_clock::now();
+        if(perf) perf->stop();
+        cout.rdbuf(saved);
+        double seconds = chrono::duration<double>(end - start).count();
+        if(best.mSeconds < 0 || seconds < best.mSeconds) {
+            best.mSeconds = seconds;
+            best.mSolutions = lines.mLines;
+            best.mNodes = max<uint64_t>(nodes, 1);
+            best.mCounters.clear();
+            if(perf) {
+                for(const PerfCounters::Event& e : perf->mEvents) {
+                    best.mCounters.push_back(e.mValue);
+                }
+            }
+        }
+    }
+    return best;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void usage() {
+    cerr << "usage: megakolmio_bench [--decks=N] [--seed=S] [--animals=A]" << endl
+         << "                        [--repeat=R] [--threads=T] [--perf]" << endl
+         << "                        [--engine=NAME]..." << endl
+         << "  --decks=N    generated 3 by 3 decks besides the built-in one (default" << endl
+         << "               8), every other one planted to have a solution; a" << endl
+         << "               planted deck of each of sides 4 and 5 is always run" << endl
+         << "  --animals=A  animals on the generated 3 by 3 decks (default 3)" << endl
+         << "  --repeat=R   runs per deck and engine, the fastest is reported" << endl
+         << "  --threads=T  workers of the parallel engine" << endl
+         << "  --perf       read cycles, instructions, branch and cache misses" << endl
+         << "  --engine     reference, fast or parallel (default all)" << endl;
+}
+
+int main(int argc, char** argv) {
+    int decks = 8, animals = 3, repeat = 3;
+    int threads = max(1u, thread::hardware_concurrency());
+    unsigned seed = 1;
+    bool perf = false;
+    vector<string> engines;
+    for(int i=1; i<argc; i++) {
+        if(strncmp(argv[i], "--decks=", 8) == 0) {
+            decks = atoi(argv[i] + 8);
+        }
+        else if(strncmp(argv[i], "--seed=", 7) == 0) {
+            seed = strtoul(argv[i] + 7, NULL, 10);
+        }
+        else if(strncmp(argv[i], "--animals=", 10) == 0) {
+            animals = atoi(argv[i] + 10);
+            if(animals < 1 || animals > (int)strlen(ANIMALS)) { usage(); return 1; }
+        }
+        else if(strncmp(argv[i], "--repeat=", 9) == 0) {
+            repeat = max(1, atoi(argv[i] + 9));
+        }
+        else if(strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = max(1, atoi(argv[i] + 10));
+        }
+        else if(strcmp(argv[i], "--perf") == 0) {
+            perf = true;
+        }
+        else if(strncmp(argv[i], "--engine=", 9) == 0) {
+            string name = argv[i] + 9;
+            if(find(begin(ENGINES), end(ENGINES), name) == end(ENGINES)) {
+                usage();
+                return 1;
+            }
+            engines.push_back(name);
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if(engines.empty()) {
+        engines.assign(begin(ENGINES), end(ENGINES));
+    }
+
+    PerfCounters counters;
+    if(perf && !counters.open()) {
+        cerr << "megakolmio_bench: perf_event counters not available" << endl;
+        perf = false;
+    }
+
+    vector<pair<string, vector<Card> > > set;
+    set.push_back(make_pair("builtin", vector<Card>(Deck::cards, Deck::cards + CARDS_IN_DECK)));
+    mt19937 random(seed);
+    for(int i=0; i<decks; i++) {
+        bool planted = i % 2 == 0;
+        set.push_back(make_pair((planted ? "planted" : "random") + to_string(i),
+                                generateDeck(random, animals, planted)));
+    }
+    for(int side=4; side<=MAX_BENCH_SIDE; side++) {
+        set.push_back(make_pair("planted/" + to_string(side),
+                                generateDeck(random, 2 * side - 2, true, side)));
+    }
+
+    cout << left << setw(10) << "deck" << setw(11) << "engine"
+         << right << setw(10) << "solutions" << setw(10) << "nodes"
+         << setw(11) << "wall_ms" << setw(9) << "ns/node";
+    if(perf) {
+        cout << setw(13) << "cycles/node" << setw(7) << "ipc"
+             << setw(14) << "brmiss/node" << setw(14) << "l1miss/node"
+             << setw(15) << "llcmiss/node";
+    }
+    cout << endl;
+
+    for(const auto& entry : set) {
+        DeckTables tables;
+        tables.build(entry.second.data(), entry.second.size());
+        tables.filter();
+        for(const string& engine : engines) {
+            // GameState only plays the 3 by 3 board.
+            if(engine == "reference" && entry.second.size() != CARDS_IN_DECK) continue;
+            Result r = measure(engine, entry.second, tables, threads,
+                               perf ? &counters : NULL, repeat);
+            cout << left << setw(10) << entry.first << setw(11) << engine
+                 << right << setw(10) << r.mSolutions << setw(10) << r.mNodes
+                 << fixed << setprecision(3) << setw(11) << 1e3 * r.mSeconds
+                 << setprecision(1) << setw(9) << 1e9 * r.mSeconds / r.mNodes;
+            if(perf) {
+                auto perNode = [&](int event, int width) {
+                    if(counters.has(event)) {
+                        cout << setprecision(2) << setw(width) << (double)r.mCounters[event] / r.mNodes;
+                    }
+                    else {
+                        cout << setw(width) << "n/a";
+                    }
+                };
+                perNode(PerfCounters::CYCLES, 13);
+                if(counters.has(PerfCounters::CYCLES) && counters.has(PerfCounters::INSTRUCTIONS) &&
+                   r.mCounters[PerfCounters::CYCLES] > 0) {
+                    cout << setprecision(2) << setw(7)
+                         << (double)r.mCounters[PerfCounters::INSTRUCTIONS] / r.mCounters[PerfCounters::CYCLES];
+                }
+                else {
+                    cout << setw(7) << "n/a";
+                }
+                perNode(PerfCounters::BRANCH_MISSES, 14);
+                perNode(PerfCounters::L1_MISSES, 14);
+                perNode(PerfCounters::LLC_MISSES, 15);
+            }
+            cout << endl;
+        }
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,290 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MEGAKOLMIO_CACHE_HPP
+#define MEGAKOLMIO_CACHE_HPP
+
+#include "megakolmio.hpp"
+
+#include <unistd.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// CANONICAL DECKS:
+// Decks that differ only in the order of the cards, their rotations or the
+// names of the animals have the same solutions up to those changes, as the
+// match rule only asks for the same animal and a head against a body.
+// Swapping head and body of one animal keeps that too. The canonical form of
+// a deck is the smallest of all those variants: animals renamed A, B, ...
+// and possibly flipped, every card turned to its smallest rotation and the
+// cards sorted.
+//
+// Renamings are not all tried. Animals are flipped so that heads are not
+// fewer than bodies and ordered by counts that do not depend on names; only
+// animals that those cannot tell apart are permuted and, with as many heads
+// as bodies, flipped both ways. A deck with more such choices than
+// MAX_LABELINGS keeps the input order among the tied animals, which is still
+// a valid form for caching, if not the only one.
+
+static const uint64_t MAX_LABELINGS = 20000;
+
+class CanonicalDeck {
+    public:
+    typedef array<sint, EDGES_IN_CARD> Edges;
+
+    vector<Card> mDeck;         // cards C0, C1, ... in canonical order
+    vector<sint> mIndex;        // caller card i is canonical card mIndex[i],
+    vector<sint> mTurn;         // showing edge (e + mTurn[i]) % 3 at edge e
+    string mKey;                // the canonical deck as a deck file
+    uint64_t mHash;
+
+    static Edges smallest(const Edges& edges, sint& turn) {
+        Edges best = edges;
+        turn = 0;
+        for(sint r=1; r<EDGES_IN_CARD; r++) {
+            Edges turned;
+            for(sint e=0; e<EDGES_IN_CARD; e++) turned[e] = edges[(e + r) % EDGES_IN_CARD];
+            if(turned < best) {
+                best = turned;
+                turn = r;
+            }
+        }
+        return best;
+    }
+
+    // Codes of the cards with animal a renamed to label[a] and flipped by
+    // flip[a].
+    static vector<Edges> relabel(const vector<Edges>& cards, const sint* label, const bool* flip) {
+        vector<Edges> out(cards.size());
+        for(size_t c=0; c<cards.size(); c++) {
+            for(sint e=0; e<EDGES_IN_CARD; e++) {
+                sint a = cards[c][e] >> 1;
+                out[c][e] = (sint)(label[a] << 1 | ((cards[c][e] & 1) ^ flip[a]));
+            }
+        }
+        return out;
+    }
+
+    static vector<Edges> form(const vector<Edges>& cards) {
+        vector<Edges> sorted;
+        for(const Edges& edges : cards) {
+            sint turn;
+            sorted.push_back(smallest(edges, turn));
+        }
+        sort(sorted.begin(), sorted.end());
+        return sorted;
+    }
+
+    CanonicalDeck(const vector<Card>& deck) {
+        const sint ANIMALS_MAX = EDGE_CODES / 2;
+        vector<Edges> cards(deck.size());
+        int heads[ANIMALS_MAX] = {0}, bodies[ANIMALS_MAX] = {0};
+        for(size_t c=0; c<deck.size(); c++) {
+            for(sint e=0; e<EDGES_IN_CARD; e++) {
+                cards[c][e] = edgeCode(deck[c].mEdges[e]);
+                (cards[c][e] & 1 ? bodies : heads)[cards[c][e] >> 1]++;
+            }
+        }
+
+        // Flip to more heads than bodies, and describe each animal by its
+        // counts and those of the animals it shares cards with, in the order
+        // around the card.
+        sint label[ANIMALS_MAX];
+        bool flip[ANIMALS_MAX];
+        vector<sint> animals, balanced;
+        for(sint a=0; a<ANIMALS_MAX; a++) {
+            label[a] = 0;
+            flip[a] = bodies[a] > heads[a];
+            if(heads[a] + bodies[a] == 0) continue;
+            animals.push_back(a);
+            if(heads[a] == bodies[a]) balanced.push_back(a);
+        }
+        auto side = [&](sint code) {
+            sint a = code >> 1;
+            return heads[a] == bodies[a] ? 2 : (code & 1) ^ flip[a];
+        };
+        auto counts = [&](sint a) {
+            return make_pair(max(heads[a], bodies[a]), min(heads[a], bodies[a]));
+        };
+        vector<vector<int> > signature(ANIMALS_MAX);
+        for(sint a : animals) {
+            vector<vector<int> > around;
+            for(const Edges& edges : cards) {
+                for(sint e=0; e<EDGES_IN_CARD; e++) {
+                    if(edges[e] >> 1 != a) continue;
+                    vector<int> seen = { side(edges[e]) };
+                    for(sint k=1; k<EDGES_IN_CARD; k++) {
+                        sint other = edges[(e + k) % EDGES_IN_CARD];
+                        seen.push_back(counts(other >> 1).first);
+                        seen.push_back(counts(other >> 1).second);
+                        seen.push_back(side(other));
+                    }
+                    around.push_back(seen);
+                }
+            }
+            sort(around.begin(), around.end());
+            vector<int>& s = signature[a];
+            s.push_back(-counts(a).first);
+            s.push_back(-counts(a).second);
+            for(const vector<int>& seen : around) s.insert(s.end(), seen.begin(), seen.end());
+        }
+        stable_sort(animals.begin(), animals.end(), [&](sint a, sint b) {
+            return signature[a] < signature[b];
+        });
+
+        // Animals with the same signature may be permuted among themselves.
+        vector<pair<size_t, size_t> > ties;        // range in animals
+        uint64_t labelings = 1ull << min<size_t>(balanced.size(), 62);
+        for(size_t i=0; i<animals.size();) {
+            size_t j = i + 1;
+            while(j < animals.size() && signature[animals[j]] == signature[animals[i]]) j++;
+            for(size_t k=2; k<=j-i && labelings <= MAX_LABELINGS; k++) labelings *= k;
+            if(j - i > 1) ties.push_back(make_pair(i, j));
+            i = j;
+        }
+        if(labelings > MAX_LABELINGS) {
+            ties.clear();
+            balanced.clear();
+        }
+
+        vector<Edges> best;
+        sint bestLabel[ANIMALS_MAX];
+        bool bestFlip[ANIMALS_MAX];
+        vector<sint> order = animals;
+        for(;;) {
+            for(uint64_t flips=0; flips < (1ull << balanced.size()); flips++) {
+                for(size_t i=0; i<balanced.size(); i++) flip[balanced[i]] = (flips >> i) & 1;
+                for(size_t i=0; i<order.size(); i++) label[order[i]] = (sint)i;
+                vector<Edges> candidate = form(relabel(cards, label, flip));
+                if(best.empty() || candidate < best) {
+                    best = candidate;
+                    memcpy(bestLabel, label, sizeof(label));
+                    memcpy(bestFlip, flip, sizeof(flip));
+                }
+            }
+            // Next permutation of the ties, odometer style.
+            size_t t = 0;
+            for(; t<ties.size(); t++) {
+                if(next_permutation(order.begin() + ties[t].first, order.begin() + ties[t].second)) break;
+            }
+            if(t == ties.size()) break;
+        }
+
+        // Caller cards to canonical ones; equal cards keep their order.
+        vector<Edges> relabeled = relabel(cards, bestLabel, bestFlip);
+        vector<pair<Edges, size_t> > keyed;
+        mTurn.resize(deck.size());
+        for(size_t c=0; c<deck.size(); c++) {
+            sint turn;
+            keyed.push_back(make_pair(smallest(relabeled[c], turn), c));
+            mTurn[c] = turn;
+        }
+        sort(keyed.begin(), keyed.end());
+        mIndex.resize(deck.size());
+        for(size_t j=0; j<keyed.size(); j++) {
+            mIndex[keyed[j].second] = (sint)j;
+            vector<string> edges;
+            for(sint e=0; e<EDGES_IN_CARD; e++) edges.push_back(edgeName(keyed[j].first[e]));
+            mDeck.push_back(Card("C" + to_string(j), edges));
+        }
+
+        ostringstream key;
+        writeDeck(key, mDeck);
+        mKey = key.str();
+        mHash = 0xcbf29ce484222325ull;             // FNV-1a
+        for(char c : mKey) {
+            mHash = (mHash ^ (unsigned char)c) * 0x100000001b3ull;
+        }
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// RESULT CACHE:
+// A directory with a file per canonical deck, named by its hash. The file
+// holds CACHE_MAGIC, the canonical deck, a "#solutions N" line and N
+// records of a byte per cell in print order: canonical card index in the low
+// 6 bits and rotation in the high 2, as in binary solution files. The deck
+// is compared on lookup so that colliding hashes only miss. Files are
+// written under a temporary name and renamed, so readers never see half of
+// one.
+
+static const char CACHE_MAGIC[] = "#megakolmio cache 1";
+
+class ResultCache {
+    public:
+    string mDirectory;
+
+    ResultCache(const string& directory) {
+        mDirectory = directory;
+    }
+
+    string path(const CanonicalDeck& canonical) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.mkc", (unsigned long long)canonical.mHash);
+        return mDirectory + name;
+    }
+
+    bool load(const CanonicalDeck& canonical, vector<char>& records) const {
+        ifstream in(path(canonical).c_str(), ios::binary);
+        string line, key;
+        if(!getline(in, line) || line != CACHE_MAGIC) return false;
+        uint64_t solutions = 0;
+        while(getline(in, line)) {
+            if(line.compare(0, 11, "#solutions ") == 0) {
+                solutions = strtoull(line.c_str() + 11, NULL, 10);
+                break;
+            }
+            key += line + "\n";
+        }
+        if(key != canonical.mKey) return false;
+        size_t cells = canonical.mDeck.size();
+        records.assign((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        return records.size() == solutions * cells;
+    }
+
+    bool store(const CanonicalDeck& canonical, const vector<char>& records) const {
+        string target = path(canonical);
+        string temporary = target + ".tmp" + to_string(getpid());
+        {
+            ofstream out(temporary.c_str(), ios::binary);
+            out << CACHE_MAGIC << "\n" << canonical.mKey
+                << "#solutions " << records.size() / canonical.mDeck.size() << "\n";
+            out.write(records.data(), records.size());
+            if(!out) {
+                unlink(temporary.c_str());
+                return false;
+            }
+        }
+        return rename(temporary.c_str(), target.c_str()) == 0;
+    }
+
+    // Record of a solution of the caller's deck in canonical terms.
+    static void record(const CanonicalDeck& canonical, const Search& s, vector<char>& records) {
+        for(sint i=0; i<s.mTables->mCards; i++) {
+            sint p = s.mTables->mPrintOrder[i];
+            sint c = s.mCard[p];
+            sint r = (s.mRotation[p] + EDGES_IN_CARD - canonical.mTurn[c]) % EDGES_IN_CARD;
+            records.push_back((char)(canonical.mIndex[c] | r << 6));
+        }
+    }
+
+    // Puts a canonical record on the board of the caller's deck.
+    static void replay(const CanonicalDeck& canonical, const char* record, Search& s) {
+        vector<sint> caller(canonical.mIndex.size());
+        for(size_t c=0; c<caller.size(); c++) caller[canonical.mIndex[c]] = (sint)c;
+        s.mUsed = 0;
+        for(sint i=0; i<s.mTables->mCards; i++) {
+            sint p = s.mTables->mPrintOrder[i];
+            sint c = caller[record[i] & 63];
+            s.mCard[p] = c;
+            s.mRotation[p] = (((unsigned char)record[i] >> 6) + canonical.mTurn[c]) % EDGES_IN_CARD;
+            s.mUsed |= 1ull << c;
+        }
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
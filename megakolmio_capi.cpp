@@ -0,0 +1,276 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#include "megakolmio.hpp"
+#include "megakolmio_capi.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// C ABI:
+// See megakolmio_capi.h. Built as a shared library with the engine's symbols
+// hidden, and the std:: templates it instantiates made local by the version
+// script, so only the mk_ functions are exported:
+//   g++ -O2 -std=c++17 -pthread -shared -fPIC -fvisibility=hidden
+//       -Wl,--version-script=megakolmio_capi.map -o libmegakolmio.so megakolmio_capi.cpp
+
+struct mk_deck {
+    vector<Card> mCards;
+};
+
+struct mk_solver {
+    vector<Card> mCards;
+    DeckTables mTables;
+    unsigned mThreads;
+    NogoodStore mNogoods;
+};
+
+// The search of an iterator hands one record at a time to the caller.
+struct mk_solutions {
+    mk_solver* mSolver;
+    thread mThread;
+    mutex mLock;
+    condition_variable mWake;
+    vector<uint8_t> mRecord;
+    bool mFull;                 // mRecord holds a solution not yet taken
+    bool mDone;                 // the search has ended
+    atomic<bool> mCancel;
+};
+
+static thread_local string lastError;
+
+static int fail(int status, const string& message) {
+    lastError = message;
+    return status;
+}
+
+// Runs body and turns the exceptions it may throw into status codes.
+template<class Body>
+static int guard(Body body) {
+    try {
+        return body();
+    }
+    catch(const bad_alloc&) {
+        return fail(MK_ERROR_MEMORY, "out of memory");
+    }
+    catch(const exception& e) {
+        return fail(MK_ERROR_INTERNAL, e.what());
+    }
+    catch(...) {
+        return fail(MK_ERROR_INTERNAL, "unknown error");
+    }
+}
+
+static void record(const Search& s, uint8_t* out) {
+    for(sint i=0; i<s.mTables->mCards; i++) {
+        sint p = s.mTables->mPrintOrder[i];
+        out[i] = (uint8_t)(s.mCard[p] | (s.mRotation[p] << 6));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int mk_abi_version(void) {
+    return MK_ABI_VERSION;
+}
+
+const char* mk_status_string(int status) {
+    switch(status) {
+        case MK_OK: return "ok";
+        case MK_DONE: return "no more solutions";
+        case MK_STOPPED: return "stopped by the callback";
+        case MK_ERROR_ARGUMENT: return "invalid argument";
+        case MK_ERROR_DECK: return "invalid deck";
+        case MK_ERROR_IO: return "cannot read file";
+        case MK_ERROR_MEMORY: return "out of memory";
+        case MK_ERROR_INTERNAL: return "internal error";
+    }
+    return "unknown status";
+}
+
+const char* mk_last_error(void) {
+    return lastError.c_str();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int mk_deck_builtin(mk_deck** deck) {
+    if(deck == NULL) return fail(MK_ERROR_ARGUMENT, "deck is NULL");
+    return guard([&]() -> int {
+        *deck = new mk_deck();
+        (*deck)->mCards.assign(Deck::cards, Deck::cards + CARDS_IN_DECK);
+        return MK_OK;
+    });
+}
+
+int mk_deck_parse(const char* text, size_t length, mk_deck** deck) {
+    if(text == NULL || deck == NULL) return fail(MK_ERROR_ARGUMENT, "text or deck is NULL");
+    return guard([&]() -> int {
+        istringstream in(string(text, length));
+        vector<Card> cards;
+        string error;
+        if(!readDeck(in, cards, error)) return fail(MK_ERROR_DECK, error);
+        *deck = new mk_deck();
+        (*deck)->mCards.swap(cards);
+        return MK_OK;
+    });
+}
+
+int mk_deck_load(const char* path, mk_deck** deck) {
+    if(path == NULL || deck == NULL) return fail(MK_ERROR_ARGUMENT, "path or deck is NULL");
+    return guard([&]() -> int {
+        ifstream in(path);
+        if(!in) return fail(MK_ERROR_IO, string("cannot open ") + path);
+        vector<Card> cards;
+        string error;
+        if(!readDeck(in, cards, error)) return fail(MK_ERROR_DECK, string(path) + ": " + error);
+        *deck = new mk_deck();
+        (*deck)->mCards.swap(cards);
+        return MK_OK;
+    });
+}
+
+size_t mk_deck_cards(const mk_deck* deck) {
+    return deck ? deck->mCards.size() : 0;
+}
+
+const char* mk_deck_card_name(const mk_deck* deck, size_t card) {
+    if(deck == NULL || card >= deck->mCards.size()) return NULL;
+    return deck->mCards[card].mName.c_str();
+}
+
+int mk_deck_format(const mk_deck* deck, const uint8_t* record, char* buffer, size_t size) {
+    if(deck == NULL || record == NULL || buffer == NULL) {
+        return fail(MK_ERROR_ARGUMENT, "deck, record or buffer is NULL");
+    }
+    return guard([&]() -> int {
+        string text = "[";
+        for(size_t i=0; i<deck->mCards.size(); i++) {
+            size_t card = record[i] & 63;
+            if(card >= deck->mCards.size()) return fail(MK_ERROR_ARGUMENT, "card out of range");
+            text += deck->mCards[card].mName;
+            if(i + 1 < deck->mCards.size()) text += ",";
+        }
+        text += "]";
+        if(text.size() >= size) return fail(MK_ERROR_ARGUMENT, "buffer too small");
+        memcpy(buffer, text.c_str(), text.size() + 1);
+        return MK_OK;
+    });
+}
+
+void mk_deck_free(mk_deck* deck) {
+    delete deck;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int mk_solver_new(const mk_deck* deck, unsigned threads, mk_solver** solver) {
+    if(deck == NULL || solver == NULL) return fail(MK_ERROR_ARGUMENT, "deck or solver is NULL");
+    return guard([&]() -> int {
+        mk_solver* s = new mk_solver();
+        s->mCards = deck->mCards;
+        s->mTables.build(s->mCards.data(), s->mCards.size());
+        s->mTables.filter();
+        s->mThreads = threads;
+        *solver = s;
+        return MK_OK;
+    });
+}
+
+int mk_solver_run(mk_solver* solver, mk_solution_callback callback, void* context) {
+    if(solver == NULL || callback == NULL) return fail(MK_ERROR_ARGUMENT, "solver or callback is NULL");
+    return guard([&]() -> int {
+        atomic<bool> stopped(false);
+        vector<uint8_t> out(solver->mTables.mCards);
+        // Workers that have not seen the stop yet may still find solutions,
+        // those are not passed on.
+        auto report = [&](const Search& s) {
+            if(stopped.load()) return;
+            record(s, out.data());
+            if(callback(context, out.data(), out.size())) stopped.store(true);
+        };
+        if(solver->mThreads > 0) {
+            // Threads of the host process are not pinned.
+            ParallelSolver parallel(&solver->mTables, solver->mThreads, false);
+            parallel.mNogoods = &solver->mNogoods;
+            parallel.mCancel = &stopped;
+            parallel.mOnSolution = report;
+            parallel.solve();
+        }
+        else {
+            Search search(&solver->mTables);
+            search.mNogoods = &solver->mNogoods;
+            search.mCancel = &stopped;
+            search.solve(0, report);
+        }
+        return stopped.load() ? MK_STOPPED : MK_OK;
+    });
+}
+
+void mk_solver_free(mk_solver* solver) {
+    delete solver;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int mk_solutions_new(mk_solver* solver, mk_solutions** solutions) {
+    if(solver == NULL || solutions == NULL) return fail(MK_ERROR_ARGUMENT, "solver or solutions is NULL");
+    return guard([&]() -> int {
+        mk_solutions* it = new mk_solutions();
+        it->mSolver = solver;
+        it->mRecord.resize(solver->mTables.mCards);
+        it->mFull = false;
+        it->mDone = false;
+        it->mCancel.store(false);
+        it->mThread = thread([it] {
+            auto handOver = [it](Search& s) {
+                unique_lock<mutex> lock(it->mLock);
+                it->mWake.wait(lock, [it] { return !it->mFull || it->mCancel.load(); });
+                if(it->mCancel.load()) {
+                    s.mStopped = true;
+                    return;
+                }
+                record(s, it->mRecord.data());
+                it->mFull = true;
+                it->mWake.notify_all();
+            };
+            Search search(&it->mSolver->mTables);
+            search.mNogoods = &it->mSolver->mNogoods;
+            search.mCancel = &it->mCancel;
+            search.solve(0, handOver);
+            lock_guard<mutex> lock(it->mLock);
+            it->mDone = true;
+            it->mWake.notify_all();
+        });
+        *solutions = it;
+        return MK_OK;
+    });
+}
+
+int mk_solutions_next(mk_solutions* solutions, uint8_t* record) {
+    if(solutions == NULL || record == NULL) return fail(MK_ERROR_ARGUMENT, "solutions or record is NULL");
+    return guard([&]() -> int {
+        unique_lock<mutex> lock(solutions->mLock);
+        solutions->mWake.wait(lock, [solutions] { return solutions->mFull || solutions->mDone; });
+        if(!solutions->mFull) return MK_DONE;
+        memcpy(record, solutions->mRecord.data(), solutions->mRecord.size());
+        solutions->mFull = false;
+        solutions->mWake.notify_all();
+        return MK_OK;
+    });
+}
+
+void mk_solutions_free(mk_solutions* solutions) {
+    if(solutions == NULL) return;
+    // Nothing to return the status to; the failure is left in mk_last_error().
+    guard([&]() -> int {
+        {
+            lock_guard<mutex> lock(solutions->mLock);
+            solutions->mCancel.store(true);
+            solutions->mWake.notify_all();
+        }
+        solutions->mThread.join();
+        delete solutions;
+        return MK_OK;
+    });
+}
+
+///////////////////////////////////////////////////////////////////////////////
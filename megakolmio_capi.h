@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MEGAKOLMIO_CAPI_H
+#define MEGAKOLMIO_CAPI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// C ABI:
+// The fast engine as a shared library, libmegakolmio.so, for callers in other
+// languages (ctypes, FFI) that want to solve in-process. Decks, solvers and
+// solution iterators are opaque handles made by the *_new functions and
+// released by the *_free ones. Every function that can fail returns an
+// mk_status; the message of the latest failure on the calling thread is
+// returned by mk_last_error(). No C++ exception leaves the library.
+//
+// A solution is a record of a byte per cell in print order, the index of the
+// card in the deck in the low 6 bits and its rotation in the high 2, as in
+// the binary solution files of megakolmio --format=binary.
+//
+// The ABI only grows: functions and status codes are added, never changed.
+// mk_abi_version() tells which of them a loaded library has.
+
+#define MK_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define MK_API __attribute__((visibility("default")))
+#else
+#define MK_API
+#endif
+
+typedef enum {
+    MK_OK = 0,
+    MK_DONE = 1,                // the iterator has no more solutions
+    MK_STOPPED = 2,             // the callback asked to stop
+    MK_ERROR_ARGUMENT = -1,     // a NULL handle or an impossible value
+    MK_ERROR_DECK = -2,         // the deck text or file is invalid
+    MK_ERROR_IO = -3,           // a file cannot be read
+    MK_ERROR_MEMORY = -4,
+    MK_ERROR_INTERNAL = -5
+} mk_status;
+
+typedef struct mk_deck mk_deck;
+typedef struct mk_solver mk_solver;
+typedef struct mk_solutions mk_solutions;
+
+// Called for every solution with its record of cells bytes. Returning
+// nonzero ends the search. With threads the calls are made from the worker
+// threads, one at a time.
+typedef int (*mk_solution_callback)(void* context, const uint8_t* record, size_t cells);
+
+MK_API int mk_abi_version(void);
+MK_API const char* mk_status_string(int status);
+MK_API const char* mk_last_error(void);
+
+// Decks, in the deck file format: a card per line with its name and edges,
+// e.g. "P1 FH FB DH".
+MK_API int mk_deck_builtin(mk_deck** deck);
+MK_API int mk_deck_parse(const char* text, size_t length, mk_deck** deck);
+MK_API int mk_deck_load(const char* path, mk_deck** deck);
+MK_API size_t mk_deck_cards(const mk_deck* deck);
+MK_API const char* mk_deck_card_name(const mk_deck* deck, size_t card);
+// Writes the record as the solver prints it, e.g. "[P7,P2,...]", with the
+// terminating NUL. Fails with MK_ERROR_ARGUMENT if size is too small.
+MK_API int mk_deck_format(const mk_deck* deck, const uint8_t* record,
+                          char* buffer, size_t size);
+MK_API void mk_deck_free(mk_deck* deck);
+
+// A solver keeps its own copy of the deck, which may be freed after this.
+// threads 0 searches on the calling thread in the order of megakolmio,
+// otherwise on that many workers. Nogoods learned by one run are kept for
+// the next ones.
+MK_API int mk_solver_new(const mk_deck* deck, unsigned threads, mk_solver** solver);
+// Calls callback for every solution; returns MK_OK when all were found and
+// MK_STOPPED when the callback ended the search.
+MK_API int mk_solver_run(mk_solver* solver, mk_solution_callback callback, void* context);
+MK_API void mk_solver_free(mk_solver* solver);
+
+// Solutions one at a time: mk_solutions_next() copies the next record to
+// record, which must hold mk_deck_cards() bytes, and returns MK_OK, or
+// MK_DONE when there are no more. The search runs on its own thread one
+// solution ahead of the caller; freeing the iterator ends it. The solver
+// must not be run or freed while an iterator of it is open.
+MK_API int mk_solutions_new(mk_solver* solver, mk_solutions** solutions);
+MK_API int mk_solutions_next(mk_solutions* solutions, uint8_t* record);
+MK_API void mk_solutions_free(mk_solutions* solutions);
+
+#ifdef __cplusplus
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#include "megakolmio_capi.h"
+
+#include <stdio.h>
+#include <string.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// C ABI SMOKE TEST:
+// Drives libmegakolmio.so through megakolmio_capi.h as a C caller would,
+// on the built-in deck or the deck file given:
+// - a bad deck, a missing file and a NULL handle fail with their status and
+//   leave a message in mk_last_error(),
+// - a run on the calling thread and one on workers find the same number of
+//   solutions, each printed by mk_deck_format() as a board,
+// - a callback returning nonzero stops the run after that solution,
+// - an iterator gives the same solutions in the same order as the run on the
+//   calling thread and can be freed half way.
+// Prints the number of solutions and exits with 1 at the first failure.
+
+static const char* program = "megakolmio_capi_test";
+
+#define CHECK(condition) do { \
+    if(!(condition)) { \
+        fprintf(stderr, "%s: line %d: %s failed, last error \"%s\"\n", \
+                program, __LINE__, #condition, mk_last_error()); \
+        return 1; \
+    } \
+} while(0)
+
+#define MAX_RECORDS 4096
+#define MAX_CELLS 64
+
+struct Collected {
+    size_t mCount;
+    size_t mStopAfter;          // 0 to run to the end
+    uint8_t mRecords[MAX_RECORDS][MAX_CELLS];
+};
+
+static struct Collected serial, parallel, stopped;
+
+static int collect(void* context, const uint8_t* record, size_t cells) {
+    struct Collected* out = (struct Collected*)context;
+    if(out->mCount < MAX_RECORDS && cells <= MAX_CELLS) {
+        memcpy(out->mRecords[out->mCount], record, cells);
+    }
+    out->mCount++;
+    return out->mStopAfter && out->mCount == out->mStopAfter;
+}
+
+int main(int argc, char** argv) {
+    mk_deck* deck = NULL;
+    mk_solver* solver = NULL;
+    mk_solver* workers = NULL;
+    mk_solutions* solutions = NULL;
+    uint8_t record[MAX_CELLS];
+    char text[MAX_CELLS * 8];
+    size_t cells, kept, i;
+
+    CHECK(mk_abi_version() >= MK_ABI_VERSION);
+
+    // Failures
+    CHECK(mk_deck_parse("P1 FH\n", 6, &deck) == MK_ERROR_DECK);
+    CHECK(mk_last_error()[0] != '\0');
+    CHECK(mk_deck_load("/nonexistent/deck.txt", &deck) == MK_ERROR_IO);
+    CHECK(strstr(mk_last_error(), "/nonexistent/deck.txt") != NULL);
+    CHECK(mk_solver_run(NULL, collect, &serial) == MK_ERROR_ARGUMENT);
+    CHECK(mk_last_error()[0] != '\0');
+
+    if(argc > 1) CHECK(mk_deck_load(argv[1], &deck) == MK_OK);
+    else CHECK(mk_deck_builtin(&deck) == MK_OK);
+    cells = mk_deck_cards(deck);
+    CHECK(cells > 0 && cells <= MAX_CELLS);
+
+    // Runs to the end
+    CHECK(mk_solver_new(deck, 0, &solver) == MK_OK);
+    CHECK(mk_solver_new(deck, 2, &workers) == MK_OK);
+    CHECK(mk_solver_run(solver, collect, &serial) == MK_OK);
+    CHECK(mk_solver_run(workers, collect, &parallel) == MK_OK);
+    CHECK(serial.mCount == parallel.mCount);
+    // Only the first MAX_RECORDS are compared.
+    kept = serial.mCount < MAX_RECORDS ? serial.mCount : MAX_RECORDS;
+    for(i=0; i<kept; i++) {
+        CHECK(mk_deck_format(deck, serial.mRecords[i], text, sizeof(text)) == MK_OK);
+        CHECK(text[0] == '[' && text[strlen(text) - 1] == ']');
+    }
+    CHECK(mk_deck_format(deck, serial.mRecords[0], text, 1) == MK_ERROR_ARGUMENT);
+
+    // Stopped by the callback
+    if(serial.mCount >= 2) {
+        stopped.mStopAfter = 2;
+        CHECK(mk_solver_run(solver, collect, &stopped) == MK_STOPPED);
+        CHECK(stopped.mCount == 2);
+        CHECK(memcmp(stopped.mRecords[1], serial.mRecords[1], cells) == 0);
+    }
+
+    // The iterator, to the end and freed half way
+    CHECK(mk_solutions_new(solver, &solutions) == MK_OK);
+    for(i=0; i<serial.mCount; i++) {
+        CHECK(mk_solutions_next(solutions, record) == MK_OK);
+        CHECK(i >= kept || memcmp(record, serial.mRecords[i], cells) == 0);
+    }
+    CHECK(mk_solutions_next(solutions, record) == MK_DONE);
+    mk_solutions_free(solutions);
+    CHECK(mk_solutions_new(solver, &solutions) == MK_OK);
+    if(serial.mCount > 0) CHECK(mk_solutions_next(solutions, record) == MK_OK);
+    mk_solutions_free(solutions);
+    CHECK(mk_solutions_next(NULL, record) == MK_ERROR_ARGUMENT);
+
+    mk_solver_free(workers);
+    mk_solver_free(solver);
+    mk_deck_free(deck);
+    printf("%s: %zu solutions, all checks passed\n", program, serial.mCount);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MEGAKOLMIO_COROUTINE_HPP
+#define MEGAKOLMIO_COROUTINE_HPP
+
+#if __cplusplus < 202002L
+#error "megakolmio_coroutine.hpp needs -std=c++20"
+#endif
+
+#include "megakolmio.hpp"
+
+#include <coroutine>
+#include <iterator>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// GENERATOR:
+// A coroutine that suspends at every co_yield and hands out a reference to
+// the value yielded, valid until the next step. Iterating resumes it; the
+// search state lives in the coroutine frame, so a generator can be kept,
+// resumed later from anywhere or dropped half way without threads or
+// callbacks.
+
+template<class T>
+class Generator {
+    public:
+    struct promise_type {
+        const T* mValue;
+
+        Generator get_return_object() {
+            return Generator(coroutine_handle<promise_type>::from_promise(*this));
+        }
+        suspend_always initial_suspend() noexcept { return {}; }
+        suspend_always final_suspend() noexcept { return {}; }
+        suspend_always yield_value(const T& value) noexcept {
+            mValue = &value;
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { throw; }
+    };
+
+    class iterator {
+        public:
+        coroutine_handle<promise_type> mHandle;
+
+        const T& operator*() const { return *mHandle.promise().mValue; }
+        const T* operator->() const { return mHandle.promise().mValue; }
+        iterator& operator++() {
+            mHandle.resume();
+            return *this;
+        }
+        bool operator==(default_sentinel_t) const { return mHandle.done(); }
+    };
+
+    Generator(Generator&& other) noexcept : mHandle(other.mHandle) {
+        other.mHandle = NULL;
+    }
+
+    ~Generator() {
+        if(mHandle) mHandle.destroy();
+    }
+
+    // Runs to the first value, so begin() is only called once.
+    iterator begin() {
+        mHandle.resume();
+        return iterator{ mHandle };
+    }
+
+    default_sentinel_t end() { return default_sentinel; }
+
+    private:
+    coroutine_handle<promise_type> mHandle;
+
+    explicit Generator(coroutine_handle<promise_type> handle) : mHandle(handle) {
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Yields the search at every solution, in the order of Search::solve(). It
+// backtracks chronologically over an explicit stack rather than recursing,
+// as each frame of a recursive generator would have to pass every solution
+// up through itself. Balance pruning applies, and so do nogoods that the
+// store already holds, though none are learned.
+inline Generator<Search> solutions(const DeckTables* tables, NogoodStore* nogoods = NULL) {
+    Search s(tables);
+    if(!tables->feasible()) co_return;
+    const sint cells = tables->mCards;
+    uint64_t left[MAX_CARDS];           // cards not yet tried per position
+    sint next[MAX_CARDS];               // next rotation of the lowest of them
+    sint position = 0;
+    left[0] = tables->mAllowed[0];
+    next[0] = 0;
+    auto undo = [&s](sint p) {
+        s.unbalance(p, s.mCard[p], s.mRotation[p]);
+        s.mUsed &= ~(1ull << s.mCard[p]);
+    };
+    for(;;) {
+        bool placed = false;
+        while(left[position] && !placed) {
+            sint c = __builtin_ctzll(left[position]);
+            sint r = next[position]++;
+            if(r == EDGES_IN_CARD) {
+                left[position] &= left[position] - 1;
+                next[position] = 0;
+                continue;
+            }
+            uint64_t others;
+            s.mCard[position] = c;
+            if(!s.fits(position, c, r) ||
+               (nogoods && nogoods->violated(s.mCard, s.mRotation, position, c, r, others))) {
+                continue;
+            }
+            s.mRotation[position] = r;
+            s.mUsed |= 1ull << c;
+            placed = s.balance(position, c, r);
+            if(!placed) undo(position);
+        }
+        if(placed && position + 1 == cells) {
+            s.mFound++;
+            co_yield s;
+            undo(position);
+        }
+        else if(placed) {
+            position++;
+            left[position] = tables->mAllowed[position] & ~s.mUsed;
+            next[position] = 0;
+        }
+        else if(position == 0) {
+            co_return;
+        }
+        else {
+            undo(--position);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
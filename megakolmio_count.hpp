@@ -0,0 +1,526 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MEGAKOLMIO_COUNT_HPP
+#define MEGAKOLMIO_COUNT_HPP
+
+#include "megakolmio.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// COUNTING:
+// Counts the solutions solve() would print, i.e. the ways to put every card
+// on the board with a rotation so that all common edges match, without
+// enumerating them.
+//
+// Cards that are rotations of each other are of the same type. The board is
+// swept in fill order and partial boards are merged when they have used the
+// same number of cards of every type and show the same symbols on the open
+// edges, the edges between a filled position and one still empty. Only
+// those two things decide how a partial board can be completed, so the
+// number of ways to reach each such signature is all that is kept.
+//
+// A type that looks the same in several rotations is placed once per look,
+// weighted by the number of rotations giving it. At the end the cards of
+// each type can be swapped among the positions of that type, which
+// multiplies the count by the factorial of each type's size.
+//
+// Merging only pays off when many partial boards share a signature. On
+// decks of mostly distinct cards the signatures grow with the search tree
+// and cost far more per node than the search does, so --count gives up on
+// the sweep past FRONTIER_LIMIT signatures at one step and runs the search.
+
+static const size_t FRONTIER_LIMIT = 1 << 18;
+
+// Counts are exact. They stay in 128 bits while they fit, which is fast and
+// almost always enough, and move to 32 bit limbs when they do not.
+class Count {
+    public:
+    unsigned __int128 mSmall;
+    vector<uint32_t> mLimbs;    // least significant first, the value once it
+                                // has outgrown mSmall
+
+    Count(uint64_t value = 0) {
+        mSmall = value;
+    }
+
+    bool isBig() const {
+        return !mLimbs.empty();
+    }
+
+    vector<uint32_t> limbs() const {
+        if(isBig()) return mLimbs;
+        vector<uint32_t> limbs;
+        for(unsigned __int128 v = mSmall; v; v >>= 32) limbs.push_back((uint32_t)v);
+        return limbs;
+    }
+
+    Count& operator+=(const Count& other) {
+        unsigned __int128 sum;
+        if(!isBig() && !other.isBig() &&
+           !__builtin_add_overflow(mSmall, other.mSmall, &sum)) {
+            mSmall = sum;
+            return *this;
+        }
+        vector<uint32_t> a = limbs();
+        vector<uint32_t> b = other.limbs();
+        if(a.size() < b.size()) a.resize(b.size(), 0);
+        uint64_t carry = 0;
+        for(size_t i=0; i<a.size(); i++) {
+            carry += (uint64_t)a[i] + (i < b.size() ? b[i] : 0);
+            a[i] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        if(carry) a.push_back((uint32_t)carry);
+        mLimbs.swap(a);
+        return *this;
+    }
+
+    Count& operator*=(uint32_t factor) {
+        if(!isBig()) {
+            unsigned __int128 product;
+            if(!__builtin_mul_overflow(mSmall, (unsigned __int128)factor, &product)) {
+                mSmall = product;
+                return *this;
+            }
+            mLimbs = limbs();
+        }
+        uint64_t carry = 0;
+        for(uint32_t& limb : mLimbs) {
+            carry += (uint64_t)limb * factor;
+            limb = (uint32_t)carry;
+            carry >>= 32;
+        }
+        if(carry) mLimbs.push_back((uint32_t)carry);
+        return *this;
+    }
+
+    // Close to the value, for weighing choices by counts.
+    long double approximate() const {
+        if(!isBig()) return (long double)mSmall;
+        long double value = 0;
+        for(size_t i=mLimbs.size(); i-- > 0;) value = value * 4294967296.0L + mLimbs[i];
+        return value;
+    }
+
+    string toString() const {
+        vector<uint32_t> n = limbs();
+        string digits;
+        // Nine decimal digits at a time.
+        while(!n.empty()) {
+            uint64_t rest = 0;
+            for(size_t i=n.size(); i-- > 0;) {
+                rest = rest << 32 | n[i];
+                n[i] = (uint32_t)(rest / 1000000000);
+                rest %= 1000000000;
+            }
+            while(!n.empty() && n.back() == 0) n.pop_back();
+            for(int d=0; d<9 && (!n.empty() || rest); d++) {
+                digits += (char)('0' + rest % 10);
+                rest /= 10;
+            }
+        }
+        if(digits.empty()) digits = "0";
+        reverse(digits.begin(), digits.end());
+        return digits;
+    }
+};
+
+inline ostream& operator<<(ostream& out, const Count& count) {
+    return out << count.toString();
+}
+
+class FrontierCounter {
+    public:
+    struct Look {
+        sint mEdge[EDGES_IN_CARD];
+        sint mRotations;        // rotations of the card that look like this
+    };
+
+    // A position of the sweep: which open edges the new card must match and
+    // where each open edge of the next frontier comes from.
+    struct Step {
+        vector<pair<sint, sint> > mChecks;      // frontier slot, edge of the card
+        vector<int> mNext;                      // >= 0 frontier slot, < 0 edge -1-e
+    };
+
+    const DeckTables* mTables;
+    vector<vector<Look> > mLooks;               // per type
+    vector<sint> mTypeSize;
+    vector<sint> mCardType;
+    vector<Step> mSteps;
+    size_t mLargest;                            // most signatures at one step
+    // count() gives up, setting mGaveUp, once a step has more signatures
+    // than this; 0 for no limit.
+    size_t mMaxStates;
+    bool mGaveUp;
+    // With mKeepLayers, the signatures before each step and after the last,
+    // for sample()
+    bool mKeepLayers;
+    vector<unordered_map<string, Count> > mLayers;
+
+    FrontierCounter(const DeckTables* tables) {
+        mTables = tables;
+        mLargest = 0;
+        mMaxStates = 0;
+        mGaveUp = false;
+        mKeepLayers = false;
+        findTypes();
+        planSweep();
+    }
+
+    void findTypes() {
+        const DeckTables& t = *mTables;
+        vector<array<sint, EDGES_IN_CARD> > keys;
+        for(sint c=0; c<t.mCards; c++) {
+            array<sint, EDGES_IN_CARD> key;
+            for(sint r=0; r<EDGES_IN_CARD; r++) {
+                array<sint, EDGES_IN_CARD> edges;
+                for(sint e=0; e<EDGES_IN_CARD; e++) edges[e] = t.mEdge[c][r][e];
+                if(r == 0 || edges < key) key = edges;
+            }
+            size_t type = find(keys.begin(), keys.end(), key) - keys.begin();
+            mCardType.push_back(type);
+            if(type == keys.size()) {
+                keys.push_back(key);
+                mTypeSize.push_back(0);
+                vector<Look> looks;
+                for(sint r=0; r<EDGES_IN_CARD; r++) {
+                    Look look;
+                    for(sint e=0; e<EDGES_IN_CARD; e++) look.mEdge[e] = t.mEdge[c][r][e];
+                    look.mRotations = 1;
+                    bool seen = false;
+                    for(Look& l : looks) {
+                        if(memcmp(l.mEdge, look.mEdge, EDGES_IN_CARD) == 0) {
+                            l.mRotations++;
+                            seen = true;
+                        }
+                    }
+                    if(!seen) looks.push_back(look);
+                }
+                mLooks.push_back(looks);
+            }
+            mTypeSize[type]++;
+        }
+    }
+
+    void planSweep() {
+        const DeckTables& t = *mTables;
+        vector<pair<sint, sint> > frontier;     // position, edge
+        for(sint p=0; p<t.mCards; p++) {
+            Step step;
+            vector<pair<sint, sint> > next;
+            vector<bool> closed(frontier.size(), false);
+            for(sint i=0; i<t.mAdjacent[p]; i++) {
+                sint q = t.mAdjacentPosition[p][i];
+                sint e = t.mAdjacentEdge[p][i];
+                if(q < p) {
+                    size_t slot = find(frontier.begin(), frontier.end(), make_pair(q, e)) - frontier.begin();
+                    step.mChecks.push_back(make_pair((sint)slot, e));
+                    closed[slot] = true;
+                }
+            }
+            for(size_t slot=0; slot<frontier.size(); slot++) {
+                if(!closed[slot]) {
+                    next.push_back(frontier[slot]);
+                    step.mNext.push_back(slot);
+                }
+            }
+            for(sint i=0; i<t.mAdjacent[p]; i++) {
+                if(t.mAdjacentPosition[p][i] > p) {
+                    next.push_back(make_pair(p, t.mAdjacentEdge[p][i]));
+                    step.mNext.push_back(-1 - t.mAdjacentEdge[p][i]);
+                }
+            }
+            mSteps.push_back(step);
+            frontier.swap(next);
+        }
+    }
+
+    // Signatures are strings: the remaining cards of each type followed by
+    // the symbols of the open edges.
+    Count count() {
+        mGaveUp = false;
+        if(!mTables->feasible()) return Count(0);
+        size_t types = mTypeSize.size();
+        unordered_map<string, Count> states, next;
+        string start(types, 0);
+        for(size_t t=0; t<types; t++) start[t] = mTypeSize[t];
+        states[start] = 1;
+        mLayers.clear();
+        for(const Step& step : mSteps) {
+            if(mKeepLayers) mLayers.push_back(states);
+            next.clear();
+            for(const auto& state : states) {
+                const string& key = state.first;
+                for(size_t t=0; t<types; t++) {
+                    if(key[t] == 0) continue;
+                    for(const Look& look : mLooks[t]) {
+                        bool fits = true;
+                        for(const auto& check : step.mChecks) {
+                            if(((sint)key[types + check.first] ^ look.mEdge[check.second]) != 1) {
+                                fits = false;
+                                break;
+                            }
+                        }
+                        if(!fits) continue;
+                        string child(types + step.mNext.size(), 0);
+                        memcpy(&child[0], key.data(), types);
+                        child[t]--;
+                        for(size_t i=0; i<step.mNext.size(); i++) {
+                            int from = step.mNext[i];
+                            child[types + i] = from >= 0 ? key[types + from] : look.mEdge[-1 - from];
+                        }
+                        Count ways = state.second;
+                        ways *= look.mRotations;
+                        next[child] += ways;
+                    }
+                }
+                if(mMaxStates && next.size() > mMaxStates) {
+                    mGaveUp = true;
+                    mLayers.clear();
+                    return Count(0);
+                }
+            }
+            states.swap(next);
+            mLargest = max(mLargest, states.size());
+        }
+        if(mKeepLayers) mLayers.push_back(states);
+        Count total;
+        for(const auto& state : states) {
+            total += state.second;
+        }
+        for(sint size : mTypeSize) {
+            for(sint k=2; k<=size; k++) {
+                total *= k;
+            }
+        }
+        return total;
+    }
+
+    // SAMPLING:
+    // Draws a solution uniformly at random once count() has run with
+    // mKeepLayers. The sweep is walked backwards from the end: every
+    // signature of a layer knows how many partial boards lead to it, so a
+    // signature and the card type and look placed at the step are drawn in
+    // proportion to those counts times the rotations giving the look. The
+    // signature before a step follows from the one after it and the look,
+    // as the edges the card closed must have been their opposites. The cards
+    // of each type are then dealt to that type's positions in random order,
+    // each in a random rotation showing its look. Every solution is one such
+    // sequence of choices, so all are equally likely.
+    template<class Random>
+    bool sample(Random& random, sint* card, sint* rotation) const {
+        const DeckTables& t = *mTables;
+        size_t types = mTypeSize.size();
+        if(mLayers.size() != mSteps.size() + 1) return false;
+        auto draw = [&random](long double total) {
+            return generate_canonical<long double, 64>(random) * total;
+        };
+
+        long double total = 0;
+        for(const auto& state : mLayers.back()) total += state.second.approximate();
+        if(total <= 0) return false;
+        long double pick = draw(total);
+        string key;
+        for(const auto& state : mLayers.back()) {
+            key = state.first;
+            pick -= state.second.approximate();
+            if(pick < 0) break;
+        }
+
+        vector<sint> type(t.mCards);
+        vector<const Look*> look(t.mCards);
+        for(sint p=t.mCards; p-- > 0;) {
+            const Step& step = mSteps[p];
+            const unordered_map<string, Count>& before = mLayers[p];
+            size_t width = step.mChecks.size();
+            for(int from : step.mNext) width += from >= 0;
+            vector<pair<string, long double> > choices;
+            vector<pair<sint, const Look*> > placed;
+            for(size_t ty=0; ty<types; ty++) {
+                if(key[ty] >= mTypeSize[ty]) continue;
+                for(const Look& l : mLooks[ty]) {
+                    string previous(types + width, 0);
+                    memcpy(&previous[0], key.data(), types);
+                    previous[ty]++;
+                    bool consistent = true;
+                    for(size_t i=0; i<step.mNext.size(); i++) {
+                        int from = step.mNext[i];
+                        if(from >= 0) previous[types + from] = key[types + i];
+                        else consistent &= key[types + i] == l.mEdge[-1 - from];
+                    }
+                    for(const auto& check : step.mChecks) {
+                        previous[types + check.first] = l.mEdge[check.second] ^ 1;
+                    }
+                    auto found = before.find(previous);
+                    if(!consistent || found == before.end()) continue;
+                    choices.push_back(make_pair(previous, found->second.approximate() * l.mRotations));
+                    placed.push_back(make_pair((sint)ty, &l));
+                }
+            }
+            total = 0;
+            for(const auto& choice : choices) total += choice.second;
+            if(total <= 0) return false;
+            pick = draw(total);
+            size_t chosen = 0;
+            while(chosen + 1 < choices.size() && (pick -= choices[chosen].second) >= 0) chosen++;
+            key = choices[chosen].first;
+            type[p] = placed[chosen].first;
+            look[p] = placed[chosen].second;
+        }
+
+        vector<vector<sint> > cards(types);
+        for(sint c=0; c<t.mCards; c++) cards[mCardType[c]].push_back(c);
+        for(vector<sint>& of : cards) shuffle(of.begin(), of.end(), random);
+        for(sint p=0; p<t.mCards; p++) {
+            card[p] = cards[type[p]].back();
+            cards[type[p]].pop_back();
+            vector<sint> showing;
+            for(sint r=0; r<EDGES_IN_CARD; r++) {
+                if(memcmp(t.mEdge[card[p]][r], look[p]->mEdge, EDGES_IN_CARD) == 0) showing.push_back(r);
+            }
+            rotation[p] = showing[uniform_int_distribution<size_t>(0, showing.size() - 1)(random)];
+        }
+        return true;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// ESTIMATING:
+// For decks whose exact count takes too long. Each probe walks from the
+// empty board down a random path of the search tree, picking uniformly among
+// the placements that fit at every position, and scores the product of the
+// numbers of choices if it fills the board and zero if it gets stuck; see
+// Search::probe(). The score is an unbiased estimate of the number of
+// solutions, so the mean over many probes converges to it. Probes are
+// independent and split over threads, each with its own generator, and the
+// sums are merged at the end. The interval is the mean plus or minus 1.96
+// standard errors; the scores are heavy tailed, so it is only trustworthy
+// once a fair number of probes have filled the board.
+class CountEstimator {
+    public:
+    const DeckTables* mTables;
+    long mProbes;
+    long mHits;                 // probes that filled the board
+    long double mMean;
+    long double mError;         // standard error of mMean
+
+    CountEstimator(const DeckTables* tables) :
+        mTables(tables), mProbes(0), mHits(0), mMean(0), mError(0) {
+    }
+
+    void run(long probes, unsigned threads, uint64_t seed) {
+        threads = max(1u, threads);
+        vector<long double> sum(threads, 0), squares(threads, 0);
+        vector<long> hits(threads, 0);
+        vector<thread> workers;
+        for(unsigned i=0; i<threads; i++) {
+            long share = probes / threads + (i < probes % threads);
+            workers.push_back(thread([this, i, share, seed, &sum, &squares, &hits] {
+                seed_seq sequence{ seed, (uint64_t)i };
+                mt19937_64 random(sequence);
+                Search search(mTables);
+                for(long n=0; n<share; n++) {
+                    double solutions = 0;
+                    search.probe(0, random, &solutions);
+                    sum[i] += solutions;
+                    squares[i] += (long double)solutions * solutions;
+                    hits[i] += solutions > 0;
+                }
+            }));
+        }
+        long double total = 0, totalSquares = 0;
+        for(unsigned i=0; i<threads; i++) {
+            workers[i].join();
+            total += sum[i];
+            totalSquares += squares[i];
+            mHits += hits[i];
+        }
+        mProbes = probes;
+        mMean = probes > 0 ? total / probes : 0;
+        long double variance = probes > 1 ?
+            max(0.0L, (totalSquares - probes * mMean * mMean) / (probes - 1)) : 0;
+        mError = probes > 0 ? sqrt(variance / probes) : 0;
+    }
+
+    long double low() const { return max(0.0L, mMean - 1.96L * mError); }
+    long double high() const { return mMean + 1.96L * mError; }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// MARGINALS:
+// How often each card lies on each cell in each rotation over all solutions,
+// gathered while searching rather than from printed solutions. Every worker
+// adds to its own histogram of cells x cards x rotations, indexed by cell in
+// print order, and merge() sums them once the search is over.
+class Marginals {
+    public:
+    const DeckTables* mTables;
+    vector<vector<uint64_t> > mWorker;
+    vector<uint64_t> mHistogram;
+    uint64_t mSolutions;
+
+    Marginals(const DeckTables* tables, int workers) :
+        mTables(tables),
+        mWorker(max(1, workers), vector<uint64_t>(size(tables), 0)),
+        mHistogram(size(tables), 0),
+        mSolutions(0) {
+    }
+
+    static size_t size(const DeckTables* tables) {
+        return (size_t)tables->mCards * tables->mCards * EDGES_IN_CARD;
+    }
+
+    size_t index(sint cell, sint card, sint rotation) const {
+        return ((size_t)cell * mTables->mCards + card) * EDGES_IN_CARD + rotation;
+    }
+
+    void add(int worker, const Search& s) {
+        vector<uint64_t>& histogram = mWorker[worker];
+        for(sint i=0; i<mTables->mCards; i++) {
+            sint p = mTables->mPrintOrder[i];
+            histogram[index(i, s.mCard[p], s.mRotation[p])]++;
+        }
+    }
+
+    void merge() {
+        fill(mHistogram.begin(), mHistogram.end(), 0);
+        for(const vector<uint64_t>& histogram : mWorker) {
+            for(size_t i=0; i<histogram.size(); i++) mHistogram[i] += histogram[i];
+        }
+        // Every solution puts one card on cell 0.
+        mSolutions = 0;
+        for(sint c=0; c<mTables->mCards; c++) {
+            for(sint r=0; r<EDGES_IN_CARD; r++) mSolutions += mHistogram[index(0, c, r)];
+        }
+    }
+
+    // A line per cell, card and rotation that occurs, with its count and
+    // its share of the solutions.
+    void output(ostream& out, const vector<Card>& cards) const {
+        ios::fmtflags flags = out.flags();
+        streamsize precision = out.precision();
+        out << "solutions: " << mSolutions << endl;
+        for(sint i=0; i<mTables->mCards; i++) {
+            for(sint c=0; c<mTables->mCards; c++) {
+                for(sint r=0; r<EDGES_IN_CARD; r++) {
+                    uint64_t n = mHistogram[index(i, c, r)];
+                    if(n == 0) continue;
+                    out << "cell " << (int)i << ": " << cards[c].mName << " rotation " << (int)r
+                        << " " << n << " " << fixed << setprecision(2)
+                        << 100.0 * n / mSolutions << "%" << endl;
+                }
+            }
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
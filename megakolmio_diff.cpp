@@ -0,0 +1,385 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#include "megakolmio.hpp"
+#include "megakolmio_count.hpp"
+#include "megakolmio_embedded.hpp"
+#if __cplusplus >= 202002L
+#include "megakolmio_coroutine.hpp"
+#endif
+
+#include <unistd.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// DIFFERENTIAL TESTING:
+// Runs every engine on the built-in deck and on generated decks, compares
+// the sets of solutions with those of the GameState search and reports how
+// long each engine took relative to it. The generated decks cycle through
+// sides 3, 4 and 5 unless --side fixes one. GameState, the C and the Python
+// implementations only know the 3 by 3 board, so on other sides they are
+// skipped and the remaining engines are compared with the fast one, and the
+// times are summed only over the decks the reference ran on. The parallel
+// engine shares learned nogoods between its workers. The C and Python
+// implementations are run as separate processes on a deck file. Every board
+// the constant-expression solve of megakolmio_embedded.hpp found must pass
+// Search::isSolved(), and the text it lays out must equal the GameState
+// output line for line.
+//
+// On decks whose sweep stays under FRONTIER_LIMIT signatures like that of
+// --count, the count of FrontierCounter must be the number of solutions.
+// On those with at most MAX_SAMPLED solutions its uniform sampler also
+// draws SAMPLES_PER_SOLUTION times as many solutions as there are. Every
+// draw must be one of the listed solutions, and the numbers of draws must
+// pass a chi-square test of uniformity at the 0.1% level, with the
+// generator seeded from --seed.
+// A deck showing only heads must be found unbalanced and solved by none of
+// the engines in this process. Built with -std=c++20 it also runs the
+// generator of megakolmio_coroutine.hpp as the coroutine engine.
+// Exits with 1 if any engine disagrees.
+
+struct Engine {
+    string mName;
+    string mCommand;        // empty for the engines in this process
+    double mSeconds;
+    int mMismatches;
+};
+
+static vector<string> runInProcess(const string& name, const vector<Card>& deck,
+                                   int threads) {
+    ostringstream out;
+    streambuf* saved = cout.rdbuf(out.rdbuf());
+    DeckTables tables;
+    tables.build(deck.data(), deck.size());
+    tables.filter();
+    if(name == "reference") {
+        Deck::played = deck.data();
+        GameState* game = new GameState();
+        solve(game);
+        delete game;
+        Deck::played = Deck::cards;
+    }
+    else if(name == "fast") {
+        Search search(&tables);
+        auto report = [](Search& s) { s.output(cout); };
+        search.solve(0, report);
+    }
+#if __cplusplus >= 202002L
+    else if(name == "coroutine") {
+        for(const Search& s : solutions(&tables)) {
+            s.output(cout);
+        }
+    }
+#endif
+    else {
+        NogoodStore nogoods;
+        ParallelSolver solver(&tables, threads, true);
+        solver.mNogoods = &nogoods;
+        solver.solve();
+    }
+    cout.rdbuf(saved);
+    vector<string> lines;
+    istringstream in(out.str());
+    string line;
+    while(getline(in, line)) lines.push_back(line);
+    return lines;
+}
+
+static bool runCommand(const string& command, const string& deckPath,
+                       vector<string>& lines) {
+    FILE* pipe = popen((command + " " + deckPath).c_str(), "r");
+    if(pipe == NULL) return false;
+    char buffer[256];
+    string line;
+    while(fgets(buffer, sizeof(buffer), pipe)) {
+        line += buffer;
+        if(!line.empty() && line[line.size()-1] == '\n') {
+            line.erase(line.size()-1);
+            lines.push_back(line);
+            line.clear();
+        }
+    }
+    return pclose(pipe) == 0;
+}
+
+// Animals of the generated decks of a side unless --animals is given, so
+// that bigger boards still have hundreds rather than millions of solutions.
+static int defaultAnimals(int side) {
+    return side <= 3 ? 3 : 2 * side - 2;
+}
+
+static const size_t MAX_SAMPLED = 4000;
+static const int SAMPLES_PER_SOLUTION = 20;
+
+// Checks the count of the frontier sweep and, on decks with at most
+// MAX_SAMPLED solutions, the sampler against the sorted solutions of the
+// deck, see above. Sets counted to false when the count is not the number
+// of solutions. Sets gaveUp and passes when the sweep grows past
+// FRONTIER_LIMIT.
+static bool checkSamples(const vector<Card>& deck, const vector<string>& expected,
+                         unsigned seed, bool& gaveUp, bool& counted) {
+    DeckTables tables;
+    tables.build(deck.data(), deck.size());
+    tables.filter();
+    FrontierCounter counter(&tables);
+    counter.mKeepLayers = true;
+    counter.mMaxStates = FRONTIER_LIMIT;
+    Count count = counter.count();
+    gaveUp = counter.mGaveUp;
+    counted = true;
+    if(gaveUp) return true;
+    counted = count.toString() == to_string(expected.size());
+    if(!counted) cout << " count=MISMATCH(" << count << ")";
+    if(expected.empty() || expected.size() > MAX_SAMPLED) return true;
+    // A line may stand for several solutions when a card looks the same in
+    // several rotations, and is then drawn that many times as often.
+    unordered_map<string, pair<size_t, long> > drawn;    // solutions, draws
+    for(const string& line : expected) drawn[line].first++;
+    long samples = SAMPLES_PER_SOLUTION * (long)expected.size();
+    Search search(&tables);
+    mt19937_64 random(seed);
+    for(long i=0; i<samples; i++) {
+        if(!counter.sample(random, search.mCard, search.mRotation)) return false;
+        ostringstream out;
+        search.output(out);
+        string line = out.str();
+        line.erase(line.size() - 1);
+        auto found = drawn.find(line);
+        if(found == drawn.end()) return false;
+        found->second.second++;
+    }
+    if(drawn.size() < 2) return true;
+    double chi = 0;
+    for(const auto& entry : drawn) {
+        double expect = (double)samples * entry.second.first / expected.size();
+        chi += (entry.second.second - expect) * (entry.second.second - expect) / expect;
+    }
+    // 99.9% point of chi-square with k-1 degrees of freedom, by the
+    // Wilson-Hilferty approximation.
+    double k = drawn.size() - 1;
+    double critical = k * pow(1 - 2 / (9 * k) + 3.090 * sqrt(2 / (9 * k)), 3);
+    return chi <= critical;
+}
+
+// Prints up to a few solutions that only one side has.
+static void showDifference(const vector<string>& expected, const vector<string>& got) {
+    vector<string> missing, extra;
+    set_difference(expected.begin(), expected.end(), got.begin(), got.end(),
+                   back_inserter(missing));
+    set_difference(got.begin(), got.end(), expected.begin(), expected.end(),
+                   back_inserter(extra));
+    for(size_t i=0; i<missing.size() && i<3; i++) cout << "    missing " << missing[i] << endl;
+    for(size_t i=0; i<extra.size() && i<3; i++) cout << "    extra   " << extra[i] << endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void usage() {
+    cerr << "usage: megakolmio_diff [--decks=N] [--seed=S] [--side=N] [--animals=A]" << endl
+         << "                       [--threads=T] [--c=PATH] [--python=COMMAND]" << endl
+         << "                       [--no-external]" << endl
+         << "  --decks=N        generated decks besides the built-in one (default 20)" << endl
+         << "  --side=N         side of the generated boards (default 3, 4 and 5 in turn)" << endl
+         << "  --animals=A      animals on the generated decks (default 3 on side 3," << endl
+         << "                   2*N-2 on bigger sides)" << endl
+         << "  --c=PATH         megakolmio.c binary (default ./megakolmio_c if present)" << endl
+         << "  --python=COMMAND command running megakolmio.py" << endl
+         << "                   (default \"python3 megakolmio.py\" if present)" << endl
+         << "  --no-external    compare only the engines in this process" << endl;
+}
+
+int main(int argc, char** argv) {
+    int decks = 20, side = 0, animals = 0;
+    int threads = max(2u, thread::hardware_concurrency());
+    unsigned seed = 1;
+    string cPath, python;
+    bool external = true;
+    for(int i=1; i<argc; i++) {
+        if(strncmp(argv[i], "--decks=", 8) == 0) {
+            decks = atoi(argv[i] + 8);
+        }
+        else if(strncmp(argv[i], "--seed=", 7) == 0) {
+            seed = strtoul(argv[i] + 7, NULL, 10);
+        }
+        else if(strncmp(argv[i], "--side=", 7) == 0) {
+            side = atoi(argv[i] + 7);
+            if(side < 2 || side > MAX_SIDE) { usage(); return 1; }
+        }
+        else if(strncmp(argv[i], "--animals=", 10) == 0) {
+            animals = atoi(argv[i] + 10);
+            if(animals < 1 || animals > (int)strlen(ANIMALS)) { usage(); return 1; }
+        }
+        else if(strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = max(1, atoi(argv[i] + 10));
+        }
+        else if(strncmp(argv[i], "--c=", 4) == 0) {
+            cPath = argv[i] + 4;
+        }
+        else if(strncmp(argv[i], "--python=", 9) == 0) {
+            python = argv[i] + 9;
+        }
+        else if(strcmp(argv[i], "--no-external") == 0) {
+            external = false;
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    vector<Engine> engines;
+    for(const char* name : { "reference", "fast", "parallel" }) {
+        engines.push_back(Engine{ name, "", 0, 0 });
+    }
+#if __cplusplus >= 202002L
+    engines.push_back(Engine{ "coroutine", "", 0, 0 });
+#endif
+    if(external) {
+        if(cPath.empty() && access("./megakolmio_c", X_OK) == 0) cPath = "./megakolmio_c";
+        if(python.empty() && access("megakolmio.py", R_OK) == 0) python = "python3 megakolmio.py";
+        if(!cPath.empty()) engines.push_back(Engine{ "c", cPath, 0, 0 });
+        else cerr << "megakolmio_diff: no C binary, skipping it" << endl;
+        if(!python.empty()) engines.push_back(Engine{ "python", python, 0, 0 });
+        else cerr << "megakolmio_diff: no megakolmio.py, skipping it" << endl;
+    }
+
+    char deckPath[] = "/tmp/megakolmio_diff_XXXXXX";
+    int fd = mkstemp(deckPath);
+    if(fd < 0) {
+        cerr << "megakolmio_diff: cannot create a deck file" << endl;
+        return 1;
+    }
+    close(fd);
+
+    vector<pair<string, vector<Card> > > set;
+    set.push_back(make_pair("builtin", vector<Card>(Deck::cards, Deck::cards + CARDS_IN_DECK)));
+    mt19937 random(seed);
+    for(int i=0; i<decks; i++) {
+        bool planted = i % 2 == 0;
+        int n = side ? side : 3 + i % 3;
+        string name = (planted ? "planted" : "random") + to_string(i);
+        if(n != 3) name += "/" + to_string(n);
+        set.push_back(make_pair(name, generateDeck(random, animals ? animals : defaultAnimals(n),
+                                                   planted, n)));
+    }
+
+    int failures = 0;
+    {
+        vector<string> expected = runInProcess("reference", set[0].second, threads);
+        vector<string> embedded;
+        istringstream in(string(EMBEDDED_TEXT.mText, EMBEDDED_TEXT.mSize));
+        string line;
+        while(getline(in, line)) embedded.push_back(line);
+        bool same = embedded == expected;
+        DeckTables tables;
+        tables.build(Deck::cards, CARDS_IN_DECK);
+        Search board(&tables);
+        same &= EMBEDDED_SOLUTIONS.mCount == (int)expected.size();
+        for(int i=0; i<EMBEDDED_SOLUTIONS.mCount; i++) {
+            for(int p=0; p<CARDS_IN_DECK; p++) {
+                board.mCard[p] = EMBEDDED_SOLUTIONS.mCard[i][p];
+                board.mRotation[p] = EMBEDDED_SOLUTIONS.mRotation[i][p];
+            }
+            same &= board.isSolved();
+        }
+        cout << left << setw(12) << "embedded" << (same ? " ok" : " MISMATCH") << endl;
+        if(!same) failures++;
+    }
+    {
+        vector<Card> heads = set[0].second;
+        for(Card& card : heads) {
+            for(string& edge : card.mEdges) edge[1] = 'H';
+        }
+        DeckTables tables;
+        tables.build(heads.data(), CARDS_IN_DECK);
+        bool same = !tables.balanced();
+        for(const Engine& engine : engines) {
+            if(engine.mCommand.empty()) same &= runInProcess(engine.mName, heads, threads).empty();
+        }
+        cout << left << setw(12) << "unbalanced" << (same ? " ok" : " MISMATCH") << endl;
+        if(!same) failures++;
+    }
+    bool shown = false;         // a failing deck has been printed
+    for(const auto& entry : set) {
+        {
+            ofstream out(deckPath);
+            writeDeck(out, entry.second);
+        }
+        vector<string> expected;
+        vector<Engine*> failed;
+        bool square = entry.second.size() == (size_t)CARDS_IN_DECK;
+        Engine& baseline = square ? engines[0] : engines[1];
+        cout << left << setw(12) << entry.first;
+        for(Engine& engine : engines) {
+            if(!square && (&engine == &engines[0] || !engine.mCommand.empty())) continue;
+            vector<string> lines;
+            bool ran = true;
+            auto start = chrono::steady_clock::now();
+            if(engine.mCommand.empty()) {
+                lines = runInProcess(engine.mName, entry.second, threads);
+            }
+            else {
+                ran = runCommand(engine.mCommand, deckPath, lines);
+            }
+            if(square) {
+                engine.mSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            }
+            sort(lines.begin(), lines.end());
+            if(&engine == &baseline) {
+                expected = lines;
+                cout << " " << engine.mName << "=" << lines.size();
+            }
+            else if(!ran || lines != expected) {
+                cout << " " << engine.mName << "=MISMATCH(" << lines.size() << ")";
+                engine.mMismatches++;
+                failed.push_back(&engine);
+            }
+            else {
+                cout << " " << engine.mName << "=ok";
+            }
+        }
+        bool gaveUp, counted;
+        bool sampled = checkSamples(entry.second, expected, seed, gaveUp, counted);
+        if(!gaveUp) {
+            if(counted) cout << " count=ok";
+            if(!expected.empty() && expected.size() <= MAX_SAMPLED) {
+                cout << " sample=" << (sampled ? "ok" : "MISMATCH");
+            }
+        }
+        cout << endl;
+        bool deckFailed = !sampled || !counted || !failed.empty();
+        if(!sampled || !counted) failures++;
+        if(deckFailed && !shown) {
+            // Show the first failing deck in full for reproducing it.
+            shown = true;
+            ostringstream deck;
+            writeDeck(deck, entry.second);
+            cout << deck.str();
+            for(Engine* engine : failed) {
+                vector<string> lines;
+                if(engine->mCommand.empty()) {
+                    lines = runInProcess(engine->mName, entry.second, threads);
+                }
+                else {
+                    runCommand(engine->mCommand, deckPath, lines);
+                }
+                sort(lines.begin(), lines.end());
+                cout << "  " << engine->mName << ":" << endl;
+                showDifference(expected, lines);
+            }
+        }
+        if(!failed.empty()) failures++;
+    }
+    unlink(deckPath);
+
+    cout << endl << left << setw(12) << "engine" << right << setw(12) << "seconds"
+         << setw(14) << "vs reference" << setw(12) << "mismatches" << endl;
+    for(const Engine& engine : engines) {
+        cout << left << setw(12) << engine.mName << right << fixed
+             << setprecision(4) << setw(12) << engine.mSeconds
+             << setprecision(3) << setw(14) << engine.mSeconds / engines[0].mSeconds
+             << setw(12) << engine.mMismatches << endl;
+    }
+    return failures ? 1 : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
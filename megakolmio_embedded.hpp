@@ -0,0 +1,161 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MEGAKOLMIO_EMBEDDED_HPP
+#define MEGAKOLMIO_EMBEDDED_HPP
+
+#include "megakolmio.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// EMBEDDED PUZZLE:
+// The built-in deck and board as constant expressions, so that the compiler
+// builds the edge tables, solves the puzzle and lays out the text the solver
+// prints, and the binary only has to write it. The search is that of
+// solve(): positions 0 to 8 in order, cards in deck order and rotations 0 to
+// 2, so the text is the same. The deck, NEIGHBORS and PRINTORDER are the
+// constant tables of megakolmio.hpp that GameState and Board also read, so
+// there is nothing to keep in step; megakolmio_diff checks that the boards
+// solveEmbedded() found are solutions and that EMBEDDED_TEXT is what the
+// GameState search prints.
+
+// The tables of megakolmio.hpp must describe the side 3 board: every cell in
+// PRINTORDER once, and every pair in NEIGHBORS an earlier and a later cell.
+constexpr bool embeddedBoardValid() {
+    bool seen[CARDS_IN_DECK] = {};
+    for(sint p : PRINTORDER) {
+        if(p >= CARDS_IN_DECK || seen[p]) return false;
+        seen[p] = true;
+    }
+    for(const auto& n : NEIGHBORS) {
+        if(n[0] >= n[1] || n[1] >= CARDS_IN_DECK || n[2] >= EDGES_IN_CARD) return false;
+    }
+    return true;
+}
+
+static_assert(embeddedBoardValid(), "PRINTORDER or NEIGHBORS do not fit the side 3 board");
+
+// Bounds of what is baked in, checked when compiling.
+static const int MAX_EMBEDDED_SOLUTIONS = 64;
+static const int MAX_EMBEDDED_TEXT = MAX_EMBEDDED_SOLUTIONS * (CARDS_IN_DECK * 4 + 2);
+
+struct EmbeddedTables {
+    // Edge code of card c in rotation r at common edge e: mEdge[c][r][e]
+    sint mEdge[CARDS_IN_DECK][EDGES_IN_CARD][EDGES_IN_CARD];
+};
+
+constexpr EmbeddedTables buildEmbeddedTables() {
+    EmbeddedTables t = {};
+    for(int c=0; c<CARDS_IN_DECK; c++) {
+        for(int r=0; r<EDGES_IN_CARD; r++) {
+            for(int e=0; e<EDGES_IN_CARD; e++) {
+                t.mEdge[c][r][e] = edgeCode(BUILTIN_DECK[c].mEdges[(e + r) % EDGES_IN_CARD]);
+            }
+        }
+    }
+    return t;
+}
+
+static constexpr EmbeddedTables EMBEDDED_TABLES = buildEmbeddedTables();
+
+struct EmbeddedSolutions {
+    int mCount;
+    sint mCard[MAX_EMBEDDED_SOLUTIONS][CARDS_IN_DECK];      // per position
+    sint mRotation[MAX_EMBEDDED_SOLUTIONS][CARDS_IN_DECK];
+};
+
+constexpr bool embeddedFits(const EmbeddedTables& t, const int* card, const int* rotation,
+                            int position) {
+    for(const auto& n : NEIGHBORS) {
+        if(n[1] != position) continue;
+        sint e = n[2];
+        if((t.mEdge[card[n[0]]][rotation[n[0]]][e] ^ t.mEdge[card[position]][rotation[position]][e]) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Backtracking over an explicit stack; card[p] and rotation[p] are the
+// placement tried at position p.
+constexpr EmbeddedSolutions solveEmbedded(const EmbeddedTables& t) {
+    EmbeddedSolutions s = {};
+    int card[CARDS_IN_DECK] = {};
+    int rotation[CARDS_IN_DECK] = {};
+    bool used[CARDS_IN_DECK] = {};
+    int p = 0;
+    for(;;) {
+        while(card[p] < CARDS_IN_DECK &&
+              (used[card[p]] || !embeddedFits(t, card, rotation, p))) {
+            if(++rotation[p] == EDGES_IN_CARD) {
+                rotation[p] = 0;
+                card[p]++;
+            }
+        }
+        if(card[p] < CARDS_IN_DECK && p + 1 < CARDS_IN_DECK) {
+            used[card[p]] = true;
+            p++;
+            card[p] = rotation[p] = 0;
+            continue;
+        }
+        if(card[p] < CARDS_IN_DECK) {
+            if(s.mCount < MAX_EMBEDDED_SOLUTIONS) {
+                for(int q=0; q<CARDS_IN_DECK; q++) {
+                    s.mCard[s.mCount][q] = card[q];
+                    s.mRotation[s.mCount][q] = rotation[q];
+                }
+            }
+            s.mCount++;
+        }
+        else if(p == 0) {
+            return s;
+        }
+        else {
+            p--;
+            used[card[p]] = false;
+        }
+        if(++rotation[p] == EDGES_IN_CARD) {
+            rotation[p] = 0;
+            card[p]++;
+        }
+    }
+}
+
+static constexpr EmbeddedSolutions EMBEDDED_SOLUTIONS = solveEmbedded(EMBEDDED_TABLES);
+
+static_assert(EMBEDDED_SOLUTIONS.mCount <= MAX_EMBEDDED_SOLUTIONS,
+              "raise MAX_EMBEDDED_SOLUTIONS");
+
+// What solve() prints for the built-in deck.
+struct EmbeddedText {
+    int mSize;
+    char mText[MAX_EMBEDDED_TEXT];
+};
+
+constexpr EmbeddedText printEmbedded(const EmbeddedSolutions& s) {
+    EmbeddedText out = {};
+    auto put = [&out](char c) {
+        if(out.mSize < MAX_EMBEDDED_TEXT) out.mText[out.mSize] = c;
+        out.mSize++;
+    };
+    for(int i=0; i<s.mCount; i++) {
+        put('[');
+        for(int j=0; j<CARDS_IN_DECK; j++) {
+            for(const char* c = BUILTIN_DECK[s.mCard[i][PRINTORDER[j]]].mName; *c; c++) {
+                put(*c);
+            }
+            put(j < CARDS_IN_DECK - 1 ? ',' : ']');
+        }
+        put('\n');
+    }
+    return out;
+}
+
+static constexpr EmbeddedText EMBEDDED_TEXT = printEmbedded(EMBEDDED_SOLUTIONS);
+
+static_assert(EMBEDDED_TEXT.mSize <= MAX_EMBEDDED_TEXT, "raise MAX_EMBEDDED_TEXT");
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,177 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#include "megakolmio.hpp"
+#include "megakolmio_verify.hpp"
+
+#ifndef MEGAKOLMIO_LIBFUZZER
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+// FUZZING:
+// Feeds arbitrary bytes to readDeck() and runs a bounded search on every
+// deck it accepts, aborting when an invariant does not hold:
+// - a deck that was read is written and read back unchanged,
+// - every solution uses each card once and passes Search::isSolved(),
+// - every solution matches on all edges when checked from the card strings,
+// - on the built-in board every solution passes GameState::isSolved(false),
+// - every solution as printed passes the --verify checks of its deck,
+// - filtering the placements and learning nogoods do not change the
+//   solutions or their order.
+//
+// With -DMEGAKOLMIO_LIBFUZZER this is a libFuzzer target, e.g.
+//     clang++ -g -O1 -std=c++17 -fsanitize=fuzzer,address
+//             -DMEGAKOLMIO_LIBFUZZER -o megakolmio_fuzz megakolmio_fuzz.cpp
+// Otherwise it builds a driver that replays the files and directories given
+// on the command line, for reproducing crashes without libFuzzer.
+
+static const uint64_t FUZZ_BUDGET = 20000;     // boards per input
+static const int FUZZ_SOLUTIONS = 64;          // solutions checked per input
+
+#define CHECK(condition) \
+    do { \
+        if(!(condition)) { \
+            cerr << "megakolmio_fuzz: invariant failed: " #condition << endl; \
+            abort(); \
+        } \
+    } while(0)
+
+static bool matchesByName(const string& e1, const string& e2) {
+    return e1[0] == e2[0] && e1[1] != e2[1];
+}
+
+static void checkSolution(const Search& s, const vector<Card>& deck, const Board& board) {
+    const DeckTables& t = *s.mTables;
+    uint64_t seen = 0;
+    for(sint p=0; p<t.mCards; p++) {
+        CHECK(s.mCard[p] < t.mCards && s.mRotation[p] < EDGES_IN_CARD);
+        CHECK(!(seen & (1ull << s.mCard[p])));
+        seen |= 1ull << s.mCard[p];
+    }
+    CHECK(seen == t.mAllCards);
+    CHECK(s.isSolved());
+
+    for(int p=0; p<board.mCells; p++) {
+        for(const Neighbor& n : board.mAdjacent[p]) {
+            const Card& c1 = deck[s.mCard[p]];
+            const Card& c2 = deck[s.mCard[n.mPosition]];
+            CHECK(matchesByName(c1.mEdges[(n.mEdge + s.mRotation[p]) % EDGES_IN_CARD],
+                                c2.mEdges[(n.mEdge + s.mRotation[n.mPosition]) % EDGES_IN_CARD]));
+        }
+    }
+
+    if(board.mCells == CARDS_IN_DECK) {
+        GameState game;
+        for(sint p=0; p<CARDS_IN_DECK; p++) {
+            game.mCardsOnBoard[p] = new PlayedCard(&deck[s.mCard[p]], p, s.mRotation[p]);
+        }
+        game.mNextOnBoard = CARDS_IN_DECK;
+        CHECK(game.isSolved(false));
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    istringstream in(string((const char*)data, size));
+    vector<Card> deck;
+    string error;
+    if(!readDeck(in, deck, error)) {
+        CHECK(!error.empty());
+        return 0;
+    }
+
+    ostringstream written;
+    writeDeck(written, deck);
+    istringstream again(written.str());
+    vector<Card> reread;
+    CHECK(readDeck(again, reread, error));
+    CHECK(reread.size() == deck.size());
+    for(size_t i=0; i<deck.size(); i++) {
+        CHECK(reread[i].mName == deck[i].mName && reread[i].mEdges == deck[i].mEdges);
+    }
+
+    Board board(Board::sideFor(deck.size()));
+    DeckTables tables;
+    tables.build(deck.data(), board);
+    DeckTables filtered = tables;
+    filtered.filter();
+    NogoodStore nogoods;
+    Verifier verifier(&tables, 1);
+    vector<string> found[2];
+    bool finished[2];
+    for(int learn=0; learn<2; learn++) {
+        Search search(learn ? &filtered : &tables);
+        search.mBudget = FUZZ_BUDGET;
+        if(learn) search.mNogoods = &nogoods;
+        auto check = [&](Search& s) {
+            checkSolution(s, deck, board);
+            ostringstream out;
+            s.output(out);
+            string printed = out.str();
+            CHECK(verifier.verify(printed.data(), printed.size(), error));
+            CHECK(verifier.mRecords == 1 && verifier.mInvalidRecord == 0);
+            found[learn].push_back(printed);
+            if(found[learn].size() == FUZZ_SOLUTIONS) s.mStopped = true;
+        };
+        search.solve(0, check);
+        CHECK(search.mUsed == 0);
+        finished[learn] = !search.mStopped;
+    }
+    // Both only prune, so they can get further within the budget.
+    CHECK(found[0].size() <= found[1].size());
+    CHECK(equal(found[0].begin(), found[0].end(), found[1].begin()));
+    CHECK(!finished[0] || found[0] == found[1]);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MEGAKOLMIO_LIBFUZZER
+
+static bool replay(const string& path, int& inputs) {
+    struct stat info;
+    if(stat(path.c_str(), &info) != 0) {
+        cerr << "megakolmio_fuzz: cannot open " << path << endl;
+        return false;
+    }
+    if(S_ISDIR(info.st_mode)) {
+        DIR* dir = opendir(path.c_str());
+        if(dir == NULL) return false;
+        vector<string> names;
+        while(struct dirent* entry = readdir(dir)) {
+            if(entry->d_name[0] != '.') names.push_back(entry->d_name);
+        }
+        closedir(dir);
+        sort(names.begin(), names.end());
+        bool ok = true;
+        for(const string& name : names) {
+            ok = replay(path + "/" + name, inputs) && ok;
+        }
+        return ok;
+    }
+    ifstream in(path.c_str(), ios::binary);
+    string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    LLVMFuzzerTestOneInput((const uint8_t*)bytes.data(), bytes.size());
+    inputs++;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if(argc < 2) {
+        cerr << "usage: megakolmio_fuzz FILE|DIRECTORY..." << endl
+             << "  runs every file through the fuzz target" << endl;
+        return 1;
+    }
+    int inputs = 0;
+    bool ok = true;
+    for(int i=1; i<argc; i++) {
+        ok = replay(argv[i], inputs) && ok;
+    }
+    cout << "megakolmio_fuzz: " << inputs << " inputs passed" << endl;
+    return ok ? 0 : 1;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,131 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#include "megakolmio.hpp"
+#include "megakolmio_cache.hpp"
+#include "megakolmio_count.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// PUZZLE GENERATION:
+// Generates decks and counts their solutions, e.g. to find puzzles with a
+// single solution. Every solution turned a third of the way round the board
+// is another one, so a single solution up to that is printed as three.
+// Renaming the animals or swapping head and body of one does
+// not change the number of solutions, so decks are grouped by their
+// canonical form and only the first deck of each relabeling class is solved;
+// its twins get the same count. With few animals or small boards the same
+// classes keep coming back and most decks are answered that way.
+//
+// Decks are counted like --count does, by the frontier sweep unless it
+// gives up past FRONTIER_LIMIT signatures and then by the search. The search
+// stops at limit solutions, MAX_LISTED or past the three turns of one for
+// --unique, and the count is then only a lower bound.
+
+static const uint64_t MAX_LISTED = 100000;
+
+static Count countSolutions(const vector<Card>& deck, uint64_t limit, bool frontier,
+                            bool& capped) {
+    DeckTables tables;
+    tables.build(deck.data(), deck.size());
+    tables.filter();
+    capped = false;
+    if(frontier) {
+        FrontierCounter counter(&tables);
+        counter.mMaxStates = FRONTIER_LIMIT;
+        Count total = counter.count();
+        if(!counter.mGaveUp) return total;
+    }
+    NogoodStore nogoods;
+    Search search(&tables);
+    search.mNogoods = &nogoods;
+    uint64_t solutions = 0;
+    auto tally = [&solutions, limit](Search& s) {
+        if(++solutions == limit) s.mStopped = true;
+    };
+    search.solve(0, tally);
+    capped = solutions == limit;
+    return solutions;
+}
+
+static void usage() {
+    cerr << "usage: megakolmio_generate [--decks=N] [--side=N] [--animals=A] [--seed=S]" << endl
+         << "                           [--random] [--unique] [--no-classes]" << endl
+         << "  --decks=N      decks to generate (default 100)" << endl
+         << "  --side=N       side of the board, n*n cards (default 3)" << endl
+         << "  --random       draw every edge independently instead of cutting the" << endl
+         << "                 deck from a solved board" << endl
+         << "  --unique       print only the decks with one solution up to turning" << endl
+         << "                 the board" << endl
+         << "  --no-classes   solve every deck, even relabeled twins of earlier ones" << endl;
+}
+
+int main(int argc, char** argv) {
+    int decks = 100, side = 3, animals = 3;
+    unsigned seed = 1;
+    bool planted = true, unique = false, classes = true;
+    for(int i=1; i<argc; i++) {
+        if(strncmp(argv[i], "--decks=", 8) == 0) {
+            decks = atoi(argv[i] + 8);
+        }
+        else if(strncmp(argv[i], "--side=", 7) == 0) {
+            side = atoi(argv[i] + 7);
+            if(side < 1 || side > MAX_SIDE) { usage(); return 1; }
+        }
+        else if(strncmp(argv[i], "--animals=", 10) == 0) {
+            animals = atoi(argv[i] + 10);
+            if(animals < 1 || animals > (int)strlen(ANIMALS)) { usage(); return 1; }
+        }
+        else if(strncmp(argv[i], "--seed=", 7) == 0) {
+            seed = strtoul(argv[i] + 7, NULL, 10);
+        }
+        else if(strcmp(argv[i], "--random") == 0) {
+            planted = false;
+        }
+        else if(strcmp(argv[i], "--unique") == 0) {
+            unique = true;
+        }
+        else if(strcmp(argv[i], "--no-classes") == 0) {
+            classes = false;
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    // Counting stops past the three turns of one solution when only unique
+    // decks are wanted.
+    uint64_t limit = unique ? EDGES_IN_CARD + 1 : MAX_LISTED;
+    unordered_map<string, pair<Count, bool> > known;     // count, capped
+    int twins = 0, kept = 0;
+    mt19937 random(seed);
+    auto start = chrono::steady_clock::now();
+    for(int i=0; i<decks; i++) {
+        vector<Card> deck = generateDeck(random, animals, planted, side);
+        Count solutions;
+        bool capped;
+        CanonicalDeck canonical(deck);
+        auto found = known.find(canonical.mKey);
+        if(classes && found != known.end()) {
+            solutions = found->second.first;
+            capped = found->second.second;
+            twins++;
+        }
+        else {
+            solutions = countSolutions(deck, limit, !unique, capped);
+            known[canonical.mKey] = make_pair(solutions, capped);
+        }
+        bool one = !solutions.isBig() && solutions.mSmall == 1;
+        if(unique && (capped || solutions.mSmall != EDGES_IN_CARD)) continue;
+        kept++;
+        cout << "# deck " << i << ": " << (capped ? "at least " : "") << solutions
+             << (one ? " solution" : " solutions") << endl;
+        writeDeck(cout, deck);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << decks << " decks, " << known.size() << " relabeling classes, "
+         << twins << " twins not solved again, " << kept << " printed, "
+         << fixed << setprecision(3) << seconds << " s" << endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,317 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MEGAKOLMIO_LOCAL_HPP
+#define MEGAKOLMIO_LOCAL_HPP
+
+#include "megakolmio.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// LOCAL SEARCH:
+// For boards far beyond what the search can finish, up to MAX_LOCAL_SIDE.
+// Every chain starts from the cards dealt at random and keeps a full board,
+// changing it by moves and scoring it by the number of internal edges that
+// do not match. A move turns one cell or swaps the cards of two cells, the
+// swapped cards taking the rotations that match best at their new cells.
+// Only the edges around the cells moved are counted again, and the cells
+// with a mismatch are kept in a set that moves mostly start from and swaps
+// mostly pair up.
+//
+// Moves are accepted by simulated annealing: always when they do not make
+// the board worse, otherwise with probability exp(-delta / T). T falls
+// geometrically over a cycle of moves and is then raised again, from the
+// best board of the chain if the current one has drifted away from it.
+// Every cycle is twice as long as the one before, so whatever the time
+// budget, the last cycles cool slowly.
+//
+// Chains run on their own threads with their own generators and share only
+// the best board, its score an atomic and the board copied under mLock.
+// solve() returns when a board matches everywhere, when the time is up or
+// when mCancel is set. The tables are built from the deck and Board like
+// DeckTables, but without its masks of cards, so any side works.
+
+class LocalSearch {
+    public:
+    const Card* mDeck;
+    Board mBoard;
+    int mCells;
+    int mEdges;                 // internal edges of the board
+    int mThreads;
+    uint64_t mSeed;
+    const atomic<bool>* mCancel;
+    // Called with every improvement under mLock, e.g. to report progress.
+    function<void(int)> mOnImprove;
+
+    // Result of solve(): the best board by position, its mismatching edges
+    // and the moves tried by all chains.
+    vector<int> mCard;
+    vector<sint> mRotation;
+    atomic<int> mBest;
+    uint64_t mMoves;
+
+    LocalSearch(const Card* deck, int cards, int threads, uint64_t seed) :
+        mBoard(Board::sideFor(cards)) {
+        mDeck = deck;
+        mCells = cards;
+        mThreads = max(1, threads);
+        mSeed = seed;
+        mCancel = NULL;
+        mBest = INT_MAX;
+        mMoves = 0;
+        mCode.resize(cards);
+        for(int c=0; c<cards; c++) {
+            for(sint e=0; e<EDGES_IN_CARD; e++) mCode[c][e] = edgeCode(deck[c].mEdges[e]);
+        }
+        mSide.assign(cards * EDGES_IN_CARD, -1);
+        mEdges = 0;
+        for(int p=0; p<cards; p++) {
+            for(const Neighbor& n : mBoard.mAdjacent[p]) {
+                mSide[p * EDGES_IN_CARD + n.mEdge] = n.mPosition;
+                mEdges += n.mPosition < p;
+            }
+        }
+    }
+
+    // Returns the number of edges of the best board that do not match.
+    int solve(chrono::milliseconds budget) {
+        mDeadline = chrono::steady_clock::now() + budget;
+        mStop = false;
+        atomic<uint64_t> moves(0);
+        vector<thread> chains;
+        for(int i=0; i<mThreads; i++) {
+            chains.push_back(thread([this, i, &moves] { moves += chain(i); }));
+        }
+        for(thread& chain : chains) chain.join();
+        mMoves = moves;
+        return mBest;
+    }
+
+    // Edges of the best board that do not match, as the two positions.
+    vector<pair<int, int> > mismatches() const {
+        vector<pair<int, int> > found;
+        for(int p=0; p<mCells; p++) {
+            for(sint e=0; e<EDGES_IN_CARD; e++) {
+                int q = mSide[p * EDGES_IN_CARD + e];
+                if(q >= 0 && q < p &&
+                   (code(mCard[p], mRotation[p], e) ^ code(mCard[q], mRotation[q], e)) != 1) {
+                    found.push_back(make_pair(q, p));
+                }
+            }
+        }
+        return found;
+    }
+
+    void output(ostream& out) const {
+        out << "[";
+        for(int i=0; i<mCells; i++) {
+            int p = mBoard.mPrintOrder[i];
+            out << mDeck[mCard[p]].mName << ":" << (int)mRotation[p] << (i + 1 < mCells ? "," : "]");
+        }
+        out << endl;
+    }
+
+    private:
+    // One chain's board with the cells that have a mismatch.
+    struct State {
+        vector<int> mCard;
+        vector<sint> mRotation;
+        vector<int> mConflicts;
+        vector<int> mSlot;      // index in mConflicts, -1 if not there
+        int mScore;
+    };
+
+    static constexpr double HOT = 1.0;
+    static constexpr double COLD = 0.1;
+    static const int CYCLE = 2000;      // moves per cell in the first cycle
+    static constexpr double FOCUS = 0.8;    // moves that start at a mismatch
+    static constexpr double PAIR = 0.8;     // swaps with another mismatch
+    static const int CHECK_TIME = 4096; // moves between looks at the clock
+
+    vector<array<sint, EDGES_IN_CARD> > mCode;  // by card, rotation 0
+    vector<int> mSide;                          // position across edge e of p: mSide[p*3+e]
+    chrono::steady_clock::time_point mDeadline;
+    atomic<bool> mStop;                         // a chain matched everywhere
+    mutex mLock;
+
+    sint code(int card, sint rotation, sint edge) const {
+        return mCode[card][(edge + rotation) % EDGES_IN_CARD];
+    }
+
+    int cost(const State& s, int p) const {
+        int bad = 0;
+        for(sint e=0; e<EDGES_IN_CARD; e++) {
+            int q = mSide[p * EDGES_IN_CARD + e];
+            if(q >= 0) {
+                bad += (code(s.mCard[p], s.mRotation[p], e) ^ code(s.mCard[q], s.mRotation[q], e)) != 1;
+            }
+        }
+        return bad;
+    }
+
+    // Cost of the edges around a and b, the one between them counted once.
+    int cost(const State& s, int a, int b) const {
+        int bad = cost(s, a) + cost(s, b);
+        for(sint e=0; e<EDGES_IN_CARD; e++) {
+            if(mSide[a * EDGES_IN_CARD + e] == b) {
+                bad -= (code(s.mCard[a], s.mRotation[a], e) ^ code(s.mCard[b], s.mRotation[b], e)) != 1;
+            }
+        }
+        return bad;
+    }
+
+    void mark(State& s, int p) const {
+        bool bad = cost(s, p) > 0;
+        if(bad && s.mSlot[p] < 0) {
+            s.mSlot[p] = s.mConflicts.size();
+            s.mConflicts.push_back(p);
+        }
+        else if(!bad && s.mSlot[p] >= 0) {
+            int last = s.mConflicts.back();
+            s.mConflicts[s.mSlot[p]] = last;
+            s.mSlot[last] = s.mSlot[p];
+            s.mConflicts.pop_back();
+            s.mSlot[p] = -1;
+        }
+    }
+
+    void remark(State& s, int p) const {
+        mark(s, p);
+        for(sint e=0; e<EDGES_IN_CARD; e++) {
+            int q = mSide[p * EDGES_IN_CARD + e];
+            if(q >= 0) mark(s, q);
+        }
+    }
+
+    void rescore(State& s) const {
+        s.mConflicts.clear();
+        s.mSlot.assign(mCells, -1);
+        s.mScore = 0;
+        for(int p=0; p<mCells; p++) {
+            s.mScore += cost(s, p);
+            mark(s, p);
+        }
+        s.mScore /= 2;
+    }
+
+    void improve(const State& s) {
+        lock_guard<mutex> lock(mLock);
+        if(s.mScore >= mBest) return;
+        mBest = s.mScore;
+        mCard = s.mCard;
+        mRotation = s.mRotation;
+        if(mOnImprove) mOnImprove(s.mScore);
+        if(s.mScore == 0) mStop = true;
+    }
+
+    uint64_t chain(int index) {
+        seed_seq sequence{ mSeed, (uint64_t)index };
+        mt19937_64 random(sequence);
+        uniform_int_distribution<int> anyCell(0, mCells - 1);
+        uniform_real_distribution<double> chance(0, 1);
+
+        State s;
+        s.mCard.resize(mCells);
+        s.mRotation.resize(mCells);
+        for(int p=0; p<mCells; p++) {
+            s.mCard[p] = p;
+            s.mRotation[p] = random() % EDGES_IN_CARD;
+        }
+        shuffle(s.mCard.begin(), s.mCard.end(), random);
+        rescore(s);
+        // The best board of the chain is only copied when the chain is about
+        // to leave it, while it improves on every move at first.
+        State best = s;
+        bool unsaved = false;
+        improve(s);
+
+        uint64_t cycle = (uint64_t)CYCLE * mCells;
+        uint64_t cycleEnd = cycle;
+        double cooling = pow(COLD / HOT, 1.0 / cycle);
+        double temperature = HOT;
+        uint64_t moves = 0;
+        for(;; moves++) {
+            if(moves % CHECK_TIME == 0 &&
+               (mStop.load(memory_order_relaxed) || (mCancel && mCancel->load(memory_order_relaxed)) ||
+                chrono::steady_clock::now() >= mDeadline)) {
+                break;
+            }
+            if(moves == cycleEnd) {
+                cycle *= 2;
+                cycleEnd += cycle;
+                cooling = pow(COLD / HOT, 1.0 / cycle);
+                if(!unsaved && s.mScore > best.mScore) s = best;
+                temperature = HOT;
+            }
+            temperature *= cooling;
+
+            int a = !s.mConflicts.empty() && chance(random) < FOCUS ?
+                s.mConflicts[random() % s.mConflicts.size()] : anyCell(random);
+            int delta;
+            int b = -1;
+            sint oldA = s.mRotation[a], oldB = 0;
+            if(mCells == 1 || chance(random) < 0.3) {
+                int before = cost(s, a);
+                s.mRotation[a] = (oldA + 1 + random() % (EDGES_IN_CARD - 1)) % EDGES_IN_CARD;
+                delta = cost(s, a) - before;
+            }
+            else {
+                do {
+                    b = s.mConflicts.size() > 1 && chance(random) < PAIR ?
+                        s.mConflicts[random() % s.mConflicts.size()] : anyCell(random);
+                } while(b == a);
+                oldB = s.mRotation[b];
+                int before = cost(s, a, b);
+                swap(s.mCard[a], s.mCard[b]);
+                int after = INT_MAX;
+                sint bestA = 0, bestB = 0;
+                for(sint ra=0; ra<EDGES_IN_CARD; ra++) {
+                    for(sint rb=0; rb<EDGES_IN_CARD; rb++) {
+                        s.mRotation[a] = ra;
+                        s.mRotation[b] = rb;
+                        int c = cost(s, a, b);
+                        if(c < after) {
+                            after = c;
+                            bestA = ra;
+                            bestB = rb;
+                        }
+                    }
+                }
+                s.mRotation[a] = bestA;
+                s.mRotation[b] = bestB;
+                delta = after - before;
+            }
+
+            bool accept = delta <= 0 || chance(random) < exp(-delta / temperature);
+            if(!accept || (delta > 0 && unsaved)) {
+                sint newA = s.mRotation[a], newB = b >= 0 ? s.mRotation[b] : 0;
+                if(b >= 0) swap(s.mCard[a], s.mCard[b]);
+                s.mRotation[a] = oldA;
+                if(b >= 0) s.mRotation[b] = oldB;
+                if(!accept) continue;
+                best = s;
+                unsaved = false;
+                if(best.mScore < mBest.load(memory_order_relaxed)) improve(best);
+                if(b >= 0) swap(s.mCard[a], s.mCard[b]);
+                s.mRotation[a] = newA;
+                if(b >= 0) s.mRotation[b] = newB;
+            }
+            s.mScore += delta;
+            remark(s, a);
+            if(b >= 0) remark(s, b);
+            if(s.mScore < best.mScore) {
+                best.mScore = s.mScore;
+                unsaved = true;
+                if(s.mScore == 0) break;
+            }
+        }
+        if(unsaved) best = s;
+        if(best.mScore < mBest.load(memory_order_relaxed)) improve(best);
+        return moves;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,251 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#include "megakolmio.hpp"
+
+#include <cmath>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// MICROBENCHMARKS:
+// Times the GameState primitives and their table based replacements over
+// random inputs. Each benchmark walks an array of prepared inputs; a sample
+// is enough walks to take about a millisecond, and the per-call times of all
+// samples are summarized. Results are folded into a volatile sink, and
+// copies passed to keep(), so the compiler cannot drop the calls.
+
+static volatile uint64_t sink;
+
+// Makes the compiler assume the object at p is read, for results that are
+// not a value, such as a copy.
+static inline void keep(const void* p) {
+    asm volatile("" : : "r"(p) : "memory");
+}
+
+struct Stats {
+    double mMin, mMedian, mMean, mStddev, mMax;
+};
+
+static Stats summarize(vector<double> ns) {
+    Stats s;
+    sort(ns.begin(), ns.end());
+    s.mMin = ns.front();
+    s.mMax = ns.back();
+    s.mMedian = ns.size() % 2 ? ns[ns.size() / 2]
+                              : (ns[ns.size() / 2 - 1] + ns[ns.size() / 2]) / 2;
+    double sum = 0;
+    for(double x : ns) sum += x;
+    s.mMean = sum / ns.size();
+    double var = 0;
+    for(double x : ns) var += (x - s.mMean) * (x - s.mMean);
+    s.mStddev = ns.size() > 1 ? sqrt(var / (ns.size() - 1)) : 0;
+    return s;
+}
+
+// Runs body(i) for every input i; body returns something to fold into sink.
+template<class Body>
+static Stats measure(size_t inputs, int samples, Body body) {
+    auto walk = [&](size_t walks) {
+        uint64_t acc = 0;
+        for(size_t w=0; w<walks; w++) {
+            for(size_t i=0; i<inputs; i++) {
+                acc += body(i);
+            }
+        }
+        sink = sink + acc;
+    };
+    // Calibrate, which also warms up caches and branch predictors.
+    size_t walks = 1;
+    for(;;) {
+        auto start = chrono::steady_clock::now();
+        walk(walks);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if(seconds > 1e-3 || walks >= (1u << 20)) break;
+        walks *= 2;
+    }
+    vector<double> ns;
+    for(int s=0; s<samples; s++) {
+        auto start = chrono::steady_clock::now();
+        walk(walks);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        ns.push_back(1e9 * seconds / (walks * inputs));
+    }
+    return summarize(ns);
+}
+
+static void print(const string& name, const Stats& s) {
+    cout << left << setw(28) << name << right << fixed << setprecision(2)
+         << setw(10) << s.mMin << setw(10) << s.mMedian << setw(10) << s.mMean
+         << setw(10) << s.mStddev << setw(10) << s.mMax << endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Random boards over a generated deck: every position gets a distinct card
+// and a random rotation. A GameState and a Search hold the same board.
+struct Inputs {
+    vector<Card> mDeck;
+    DeckTables mTables;
+    vector<GameState*> mStates;
+    vector<Search> mSearches;
+    vector<pair<sint, sint> > mPairs;   // neighbor positions from NEIGHBORMAP
+    vector<sint> mPairEdges;            // and their common edges
+    vector<sint> mFrom;                 // card to look for a free one from
+
+    Inputs(mt19937& random, size_t boards) {
+        mDeck = generateDeck(random, 3, true);
+        mTables.build(mDeck.data(), CARDS_IN_DECK);
+        Deck::played = mDeck.data();
+        for(const auto& i : NEIGHBORMAP) {
+            mPairs.push_back(make_pair(i.first[0] - '0', i.first[1] - '0'));
+            mPairEdges.push_back(i.second);
+        }
+        uniform_int_distribution<int> rotation(0, EDGES_IN_CARD - 1);
+        uniform_int_distribution<int> cards(0, CARDS_IN_DECK);
+        vector<int> order(CARDS_IN_DECK);
+        for(int i=0; i<CARDS_IN_DECK; i++) order[i] = i;
+        for(size_t b=0; b<boards; b++) {
+            shuffle(order.begin(), order.end(), random);
+            GameState* state = new GameState();
+            Search search(&mTables);
+            for(int p=0; p<CARDS_IN_DECK; p++) {
+                sint r = rotation(random);
+                state->mCardsOnBoard[p] = new PlayedCard(&mDeck[order[p]], p, r);
+                search.mCard[p] = order[p];
+                search.mRotation[p] = r;
+                search.mUsed |= 1ull << order[p];
+            }
+            state->mNextOnBoard = CARDS_IN_DECK;
+            mStates.push_back(state);
+            mSearches.push_back(search);
+            mFrom.push_back(cards(random));
+        }
+    }
+
+    ~Inputs() {
+        for(GameState* s : mStates) delete s;
+        Deck::played = Deck::cards;
+    }
+
+    // Drops the cards of the later positions so that nextFromDeck() has
+    // something to find.
+    void truncate(mt19937& random) {
+        uniform_int_distribution<int> filled(0, CARDS_IN_DECK - 1);
+        for(size_t b=0; b<mStates.size(); b++) {
+            int keep = filled(random);
+            GameState* state = mStates[b];
+            for(int p=keep; p<CARDS_IN_DECK; p++) {
+                delete state->mCardsOnBoard[p];
+                state->mCardsOnBoard[p] = NULL;
+                mSearches[b].mUsed &= ~(1ull << mSearches[b].mCard[p]);
+            }
+            state->mNextOnBoard = keep;
+        }
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void usage() {
+    cerr << "usage: megakolmio_microbench [--samples=N] [--inputs=N] [--seed=S]" << endl
+         << "                             [--filter=TEXT]" << endl
+         << "  --samples=N  timed samples per benchmark (default 25)" << endl
+         << "  --inputs=N   random boards walked by each sample (default 4096)" << endl
+         << "  --filter     run only the benchmarks whose name contains TEXT" << endl;
+}
+
+int main(int argc, char** argv) {
+    int samples = 25;
+    size_t inputs = 4096;
+    unsigned seed = 1;
+    string filter;
+    for(int i=1; i<argc; i++) {
+        if(strncmp(argv[i], "--samples=", 10) == 0) {
+            samples = max(1, atoi(argv[i] + 10));
+        }
+        else if(strncmp(argv[i], "--inputs=", 9) == 0) {
+            inputs = max(1, atoi(argv[i] + 9));
+        }
+        else if(strncmp(argv[i], "--seed=", 7) == 0) {
+            seed = strtoul(argv[i] + 7, NULL, 10);
+        }
+        else if(strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    auto wanted = [&](const string& name) {
+        return name.find(filter) != string::npos;
+    };
+
+    mt19937 random(seed);
+    Inputs in(random, inputs);
+    const DeckTables& t = in.mTables;
+    size_t pairs = in.mPairs.size();
+
+    cout << left << setw(28) << "ns/call" << right << setw(10) << "min"
+         << setw(10) << "median" << setw(10) << "mean" << setw(10) << "stddev"
+         << setw(10) << "max" << endl;
+
+    if(wanted("matchesNeighbor")) {
+        print("matchesNeighbor", measure(inputs, samples, [&](size_t i) {
+            const pair<sint, sint>& p = in.mPairs[i % pairs];
+            GameState* s = in.mStates[i];
+            return s->mCardsOnBoard[p.first]->matchesNeighbor(s->mCardsOnBoard[p.second]);
+        }));
+    }
+    if(wanted("DeckTables::matches")) {
+        print("DeckTables::matches", measure(inputs, samples, [&](size_t i) {
+            const pair<sint, sint>& p = in.mPairs[i % pairs];
+            const Search& s = in.mSearches[i];
+            return t.matches(s.mCard[p.first], s.mRotation[p.first],
+                             s.mCard[p.second], s.mRotation[p.second],
+                             in.mPairEdges[i % pairs]);
+        }));
+    }
+    if(wanted("GameState::isSolved")) {
+        print("GameState::isSolved", measure(inputs, samples, [&](size_t i) {
+            return in.mStates[i]->isSolved(false);
+        }));
+    }
+    if(wanted("Search::isSolved")) {
+        print("Search::isSolved", measure(inputs, samples, [&](size_t i) {
+            return in.mSearches[i].isSolved();
+        }));
+    }
+    if(wanted("GameState::replicate")) {
+        print("GameState::replicate", measure(inputs, samples, [&](size_t i) {
+            GameState* copy = in.mStates[i]->replicate();
+            uint64_t top = copy->mTopOfTheDeck;
+            delete copy;
+            return top;
+        }));
+    }
+    if(wanted("Search copy")) {
+        print("Search copy", measure(inputs, samples, [&](size_t i) {
+            Search copy = in.mSearches[i];
+            keep(&copy);
+            return (uint64_t)copy.mUsed;
+        }));
+    }
+
+    in.truncate(random);
+    if(wanted("GameState::nextFromDeck")) {
+        print("GameState::nextFromDeck", measure(inputs, samples, [&](size_t i) {
+            GameState* s = in.mStates[i];
+            s->mTopOfTheDeck = in.mFrom[i];
+            const Card* card = s->nextFromDeck();
+            return card ? (uint64_t)(card - in.mDeck.data()) : 0;
+        }));
+    }
+    if(wanted("Search::nextFree")) {
+        print("Search::nextFree", measure(inputs, samples, [&](size_t i) {
+            return (uint64_t)in.mSearches[i].nextFree(in.mFrom[i]);
+        }));
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,301 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MEGAKOLMIO_REPAIR_HPP
+#define MEGAKOLMIO_REPAIR_HPP
+
+#include "megakolmio.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// MAXIMUM MATCHING:
+// For decks without a solution: puts every card on the board so that as many
+// internal edges as possible match. Branch and bound over the fill order,
+// where a node is pruned when the edges matched so far plus an upper bound
+// for the cells still empty cannot beat the best board found so far.
+//
+// The bound gives each empty cell the edges to its earlier neighbors. Those
+// to empty neighbors count as matched; those to filled ones count as much as
+// the free card and rotation matching most of them would get, taken from
+// the mShowing masks. A second bound counts what the edges left can pair up:
+// per animal, the heads of the free cards and those the filled cells show
+// towards empty ones against the bodies likewise, where two edges of filled
+// cells cannot pair. The smaller of the two is used. Cards that are
+// rotations of each other and rotations that show the same edges are only
+// tried once per cell.
+//
+// The incumbent starts as the board that puts on every cell in turn the
+// free card and rotation matching most, so there is a full board to report
+// however soon the search is stopped. Workers take prefixes of the first two
+// cells from a shared counter and share the incumbent: its score is an
+// atomic read at every node, the board is written under mLock. Run it on
+// tables that filter() has not narrowed, as placements that cannot be part
+// of a solution can still be part of the best near-solution.
+
+class MatchMaximizer {
+    public:
+    const DeckTables* mTables;
+    int mThreads;
+    int mEdges;                 // internal edges of the board
+    int mCap;                   // no board can match more than this
+    const atomic<bool>* mCancel;
+    // Called with every improvement under mLock, e.g. to report progress.
+    function<void(const Search&, int)> mOnImprove;
+
+    // Result of solve()
+    atomic<int> mBest;
+    Search mBoard;
+    uint64_t mNodes;
+    bool mComplete;             // mBest is known to be the maximum
+
+    MatchMaximizer(const DeckTables* tables, int threads) : mBoard(tables) {
+        mTables = tables;
+        mThreads = max(1, threads);
+        mCancel = NULL;
+        mBest = -1;
+        mNodes = 0;
+        mComplete = false;
+        mEdges = 0;
+        for(sint p=0; p<tables->mCards; p++) mEdges += tables->mNeighbors[p];
+        mCap = 0;
+        for(sint a=0; a<EDGE_CODES; a+=2) {
+            mCap += min(tables->mSupply[a], tables->mSupply[a + 1]);
+        }
+        mCap = min(mCap, mEdges);
+        for(sint c=0; c<tables->mCards; c++) {
+            mTwin[c] = c;
+            for(sint d=0; d<c && mTwin[c] == c; d++) {
+                for(sint r=0; r<EDGES_IN_CARD; r++) {
+                    if(memcmp(tables->mEdge[d][r], tables->mEdge[c][0], EDGES_IN_CARD) == 0) mTwin[c] = d;
+                }
+            }
+            for(sint r=0; r<EDGES_IN_CARD; r++) {
+                mSameLook[c][r] = false;
+                for(sint q=0; q<r; q++) {
+                    mSameLook[c][r] |= memcmp(tables->mEdge[c][q], tables->mEdge[c][r], EDGES_IN_CARD) == 0;
+                }
+            }
+        }
+    }
+
+    // Returns the number of matching edges of mBoard.
+    int solve() {
+        const DeckTables& t = *mTables;
+        vector<pair<int, Task> > prefixes;
+        Search s(mTables);
+        int greedy = 0;
+        for(sint p=0; p<t.mCards; p++) {
+            Choice best = choices(s, p).front();
+            place(s, p, best);
+            greedy += best.mGain;
+        }
+        improve(s, greedy);
+        s.mUsed = 0;
+        for(const Choice& first : choices(s, 0)) {
+            place(s, 0, first);
+            if(t.mCards == 1) {
+                prefixes.push_back(make_pair(first.mGain, Task{ first, first }));
+            }
+            for(const Choice& second : t.mCards > 1 ? choices(s, 1) : vector<Choice>()) {
+                prefixes.push_back(make_pair(first.mGain + second.mGain, Task{ first, second }));
+            }
+            s.mUsed &= ~(1ull << first.mCard);
+        }
+        stable_sort(prefixes.begin(), prefixes.end(),
+                    [](const pair<int, Task>& a, const pair<int, Task>& b) { return a.first > b.first; });
+
+        atomic<size_t> next(0);
+        atomic<uint64_t> nodes(0);
+        mStop = false;
+        vector<thread> workers;
+        for(int i=0; i<mThreads; i++) {
+            workers.push_back(thread([this, &prefixes, &next, &nodes] {
+                Search s(mTables);
+                uint64_t visited = 0;
+                while(!stopped()) {
+                    size_t k = next++;
+                    if(k >= prefixes.size()) break;
+                    const Task& task = prefixes[k].second;
+                    place(s, 0, task.mFirst);
+                    if(mTables->mCards > 1) place(s, 1, task.mSecond);
+                    descend(s, min((int)mTables->mCards, 2), prefixes[k].first, visited);
+                    s.mUsed = 0;
+                }
+                nodes += visited;
+            }));
+        }
+        for(thread& worker : workers) worker.join();
+        mNodes = nodes;
+        mComplete = mBest == mCap || !(mCancel && mCancel->load());
+        return mBest;
+    }
+
+    // Edges of the board that do not match, as positions and common edge.
+    vector<array<sint, 3> > mismatches() const {
+        vector<array<sint, 3> > found;
+        const DeckTables& t = *mTables;
+        for(sint p=0; p<t.mCards; p++) {
+            for(sint i=0; i<t.mNeighbors[p]; i++) {
+                sint other = t.mNeighborPosition[p][i], e = t.mNeighborEdge[p][i];
+                if(!t.matches(mBoard.mCard[p], mBoard.mRotation[p],
+                              mBoard.mCard[other], mBoard.mRotation[other], e)) {
+                    found.push_back(array<sint, 3>{ other, p, e });
+                }
+            }
+        }
+        return found;
+    }
+
+    private:
+    struct Choice {
+        sint mCard;
+        sint mRotation;
+        int mGain;              // earlier neighbors it matches
+    };
+
+    struct Task {
+        Choice mFirst;
+        Choice mSecond;
+    };
+
+    sint mTwin[MAX_CARDS];                      // lowest card that is a rotation of it
+    bool mSameLook[MAX_CARDS][EDGES_IN_CARD];   // an earlier rotation looks the same
+    atomic<bool> mStop;                         // a board reached mCap
+    mutex mLock;
+
+    bool stopped() const {
+        return mStop.load(memory_order_relaxed) || (mCancel && mCancel->load(memory_order_relaxed));
+    }
+
+    void place(Search& s, sint position, const Choice& choice) const {
+        s.mCard[position] = choice.mCard;
+        s.mRotation[position] = choice.mRotation;
+        s.mUsed |= 1ull << choice.mCard;
+    }
+
+    int gain(const Search& s, sint position, sint card, sint rotation) const {
+        const DeckTables& t = *mTables;
+        int matched = 0;
+        for(sint i=0; i<t.mNeighbors[position]; i++) {
+            sint other = t.mNeighborPosition[position][i];
+            matched += t.matches(card, rotation, s.mCard[other], s.mRotation[other],
+                                 t.mNeighborEdge[position][i]);
+        }
+        return matched;
+    }
+
+    // Free cards and rotations for the position, distinct looks only, with
+    // those matching most first.
+    vector<Choice> choices(const Search& s, sint position) const {
+        const DeckTables& t = *mTables;
+        vector<Choice> found;
+        uint64_t free = t.mAllCards & ~s.mUsed;
+        uint64_t tried = 0;
+        for(uint64_t left = free; left; left &= left - 1) {
+            sint c = __builtin_ctzll(left);
+            if(tried & (1ull << mTwin[c])) continue;
+            tried |= 1ull << mTwin[c];
+            for(sint r=0; r<EDGES_IN_CARD; r++) {
+                if(!mSameLook[c][r]) found.push_back(Choice{ c, r, gain(s, position, c, r) });
+            }
+        }
+        stable_sort(found.begin(), found.end(),
+                    [](const Choice& a, const Choice& b) { return a.mGain > b.mGain; });
+        return found;
+    }
+
+    // Most edges to earlier neighbors an empty position can match: the
+    // filled neighbors a single free card can match plus the empty ones.
+    int optimistic(const Search& s, sint position, sint filled) const {
+        const DeckTables& t = *mTables;
+        uint64_t free = t.mAllCards & ~s.mUsed;
+        int best = 0;
+        for(sint r=0; r<EDGES_IN_CARD && best < t.mNeighbors[position]; r++) {
+            uint64_t mask[EDGES_IN_CARD];
+            int masks = 0;
+            int empty = 0;
+            for(sint i=0; i<t.mNeighbors[position]; i++) {
+                sint other = t.mNeighborPosition[position][i];
+                if(other >= filled) {
+                    empty++;
+                    continue;
+                }
+                sint e = t.mNeighborEdge[position][i];
+                mask[masks++] = t.mShowing[r][e][t.mEdge[s.mCard[other]][s.mRotation[other]][e] ^ 1] & free;
+            }
+            int most = 0;
+            if(masks == 1) most = mask[0] != 0;
+            else if(masks == 2) most = (mask[0] & mask[1]) ? 2 : (mask[0] | mask[1]) != 0;
+            else if(masks == 3) {
+                most = (mask[0] & mask[1] & mask[2]) ? 3 :
+                       ((mask[0] & mask[1]) | (mask[0] & mask[2]) | (mask[1] & mask[2])) ? 2 :
+                       (mask[0] | mask[1] | mask[2]) != 0;
+            }
+            best = max(best, most + empty);
+        }
+        return best;
+    }
+
+    // Most edges that can still match with cells from position on empty, by
+    // the head and body edges left for them.
+    int supply(const Search& s, sint position) const {
+        const DeckTables& t = *mTables;
+        int free[EDGE_CODES] = {}, open[EDGE_CODES] = {};
+        for(uint64_t left = t.mAllCards & ~s.mUsed; left; left &= left - 1) {
+            sint c = __builtin_ctzll(left);
+            for(sint e=0; e<EDGES_IN_CARD; e++) free[t.mEdge[c][0][e]]++;
+        }
+        for(sint q=position; q<t.mCards; q++) {
+            for(sint i=0; i<t.mNeighbors[q]; i++) {
+                sint other = t.mNeighborPosition[q][i];
+                if(other < position) open[t.mEdge[s.mCard[other]][s.mRotation[other]][t.mNeighborEdge[q][i]]]++;
+            }
+        }
+        int pairs = 0;
+        for(sint a=0; a<EDGE_CODES; a+=2) {
+            pairs += min(min(free[a] + open[a], free[a + 1] + open[a + 1]), free[a] + free[a + 1]);
+        }
+        return pairs;
+    }
+
+    void improve(const Search& s, int matched) {
+        lock_guard<mutex> lock(mLock);
+        if(matched <= mBest) return;
+        mBest = matched;
+        for(sint p=0; p<mTables->mCards; p++) {
+            mBoard.mCard[p] = s.mCard[p];
+            mBoard.mRotation[p] = s.mRotation[p];
+        }
+        mBoard.mUsed = s.mUsed;
+        if(mOnImprove) mOnImprove(mBoard, matched);
+        if(matched >= mCap) mStop = true;
+    }
+
+    void descend(Search& s, sint position, int matched, uint64_t& visited) {
+        const DeckTables& t = *mTables;
+        visited++;
+        if(position == t.mCards) {
+            improve(s, matched);
+            return;
+        }
+        if(stopped()) return;
+        // Bound of the positions after this one, with this one still empty.
+        int rest = 0;
+        for(sint q=position+1; q<t.mCards; q++) rest += optimistic(s, q, position);
+        int best = mBest.load(memory_order_relaxed);
+        int bound = min(optimistic(s, position, position) + rest, supply(s, position));
+        if(min(mCap, matched + bound) <= best) return;
+        for(const Choice& choice : choices(s, position)) {
+            if(min(mCap, matched + choice.mGain + rest) <= mBest.load(memory_order_relaxed)) break;
+            place(s, position, choice);
+            descend(s, position + 1, matched + choice.mGain, visited);
+            s.mUsed &= ~(1ull << choice.mCard);
+            if(stopped()) return;
+        }
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
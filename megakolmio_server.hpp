@@ -0,0 +1,594 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MEGAKOLMIO_SERVER_HPP
+#define MEGAKOLMIO_SERVER_HPP
+
+#include "megakolmio.hpp"
+
+#include <map>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// SOLVER SERVICE PROTOCOL:
+// A frame is a 32 bit little endian length and that many bytes of payload,
+// the first of which is the frame type. Numbers are little endian.
+//
+// Client to service:
+//   'S' id:u32 deadline:u32 limit:u64 deck   solve the deck, given as a deck
+//                                            file, within deadline
+//                                            milliseconds (0 for none) and
+//                                            stop after limit solutions (0 for
+//                                            all)
+//   'C' id:u32                               cancel a request
+// Service to client:
+//   'R' id:u32 record                        a solution, a byte per cell in
+//                                            print order as in binary solution
+//                                            files
+//   'D' id:u32 status:u8 solutions:u64 text  the request has ended, with the
+//                                            number of solutions sent and for
+//                                            STATUS_INVALID the reason
+//
+// Requests on one connection may overlap and are told apart by their ids.
+
+static const char FRAME_SOLVE = 'S';
+static const char FRAME_CANCEL = 'C';
+static const char FRAME_SOLUTION = 'R';
+static const char FRAME_DONE = 'D';
+
+static const size_t MAX_FRAME = 1 << 20;
+static const size_t MAX_OUTBOX = 1 << 22;   // bytes queued for one connection
+static const int MAX_STALL_MS = 10000;      // full outbox without a write
+
+enum {
+    STATUS_RUNNING = -1,
+    STATUS_COMPLETE = 0,        // every solution was sent
+    STATUS_LIMIT = 1,           // the limit was reached
+    STATUS_DEADLINE = 2,
+    STATUS_CANCELLED = 3,       // by the client or by closing the connection
+    STATUS_INVALID = 4,
+    STATUS_STALLED = 5          // the client stopped reading the solutions
+};
+
+// What the client reports for a status; STATUS_INVALID carries its reason.
+inline const char* statusMessage(int status) {
+    switch(status) {
+        case STATUS_COMPLETE: return "complete";
+        case STATUS_LIMIT: return "stopped at the limit";
+        case STATUS_DEADLINE: return "deadline passed";
+        case STATUS_CANCELLED: return "cancelled";
+        case STATUS_INVALID: return "invalid request";
+        case STATUS_STALLED:
+            return "cancelled: the client did not read the solutions fast enough";
+    }
+    return "unknown status";
+}
+
+inline void putU32(string& out, uint32_t value) {
+    for(int i=0; i<4; i++) out += (char)(value >> 8 * i);
+}
+
+inline void putU64(string& out, uint64_t value) {
+    for(int i=0; i<8; i++) out += (char)(value >> 8 * i);
+}
+
+inline uint32_t getU32(const char* in) {
+    uint32_t value = 0;
+    for(int i=0; i<4; i++) value |= (uint32_t)(unsigned char)in[i] << 8 * i;
+    return value;
+}
+
+inline uint64_t getU64(const char* in) {
+    uint64_t value = 0;
+    for(int i=0; i<8; i++) value |= (uint64_t)(unsigned char)in[i] << 8 * i;
+    return value;
+}
+
+inline bool readFully(int fd, char* data, size_t size) {
+    while(size > 0) {
+        ssize_t got = read(fd, data, size);
+        if(got < 0 && errno == EINTR) continue;
+        if(got <= 0) return false;
+        data += got;
+        size -= got;
+    }
+    return true;
+}
+
+inline bool writeFully(int fd, const char* data, size_t size) {
+    while(size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if(sent < 0 && errno == EINTR) continue;
+        if(sent <= 0) return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+inline bool readFrame(int fd, string& payload) {
+    char length[4];
+    if(!readFully(fd, length, sizeof(length))) return false;
+    uint32_t size = getU32(length);
+    if(size == 0 || size > MAX_FRAME) return false;
+    payload.resize(size);
+    return readFully(fd, &payload[0], size);
+}
+
+inline bool writeFrame(int fd, const string& payload) {
+    string frame;
+    putU32(frame, payload.size());
+    frame += payload;
+    return writeFully(fd, frame.data(), frame.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// SOLVER SERVICE:
+// Listens on a Unix domain socket and solves the decks clients send with one
+// pool of workers for all of them, so the number of workers bounds the
+// solving done on the host however many clients there are. Every request is
+// split into Tasks like in ParallelSolver, and the tasks are dealt to the
+// workers' queues; a worker pops from the front of its own queue and steals
+// from the back of the others. Workers queue the solutions they find in the
+// connection's outbox, which a thread of the connection writes to the
+// socket. When the outbox holds MAX_OUTBOX bytes a worker waits for the
+// writer to make room, so a client that reads slowly slows its requests
+// down. Only once MAX_STALL_MS pass without a frame written is the
+// solution dropped and the request ended with STATUS_STALLED.
+//
+// A request ends when all its tasks are done or stopped. Its tasks stop at
+// the next check of Search::mCancel once the deadline passes, the client
+// cancels it or goes away, or the limit is reached.
+
+class ServiceConnection {
+    public:
+    int mFd;
+    mutex mLock;
+    condition_variable mWake;
+    condition_variable mRoom;
+    deque<string> mOutbox;      // frames not yet written
+    size_t mQueued;             // their bytes
+    uint64_t mWritten;          // frames written so far
+    bool mClosed;
+
+    ServiceConnection(int fd) {
+        mFd = fd;
+        mQueued = 0;
+        mWritten = 0;
+        mClosed = false;
+    }
+
+    ~ServiceConnection() {
+        close(mFd);
+    }
+
+    // Queues the frame, waiting while the outbox is full and the writer
+    // keeps writing. Returns false if the connection is closed, cancel is
+    // set while waiting, or nothing was written for MAX_STALL_MS; stalled
+    // tells the last apart. A final frame is queued without waiting, as
+    // every request sends one.
+    bool send(const string& payload, bool final = false,
+              const atomic<bool>* cancel = NULL, bool* stalled = NULL) {
+        typedef chrono::steady_clock Clock;
+        unique_lock<mutex> lock(mLock);
+        uint64_t written = mWritten;
+        Clock::time_point giveUp = Clock::now() + chrono::milliseconds(MAX_STALL_MS);
+        while(!final && !mClosed && mQueued > 0 && mQueued + payload.size() > MAX_OUTBOX) {
+            // Polled, as cancel is not set under this lock.
+            if(cancel && cancel->load()) return false;
+            Clock::time_point now = Clock::now();
+            if(mWritten != written) {
+                written = mWritten;
+                giveUp = now + chrono::milliseconds(MAX_STALL_MS);
+            }
+            else if(now >= giveUp) {
+                if(stalled) *stalled = true;
+                return false;
+            }
+            mRoom.wait_for(lock, chrono::milliseconds(100));
+        }
+        if(mClosed) return false;
+        mOutbox.push_back(payload);
+        mQueued += payload.size();
+        mWake.notify_one();
+        return true;
+    }
+
+    // Writes the outbox until the connection is closed.
+    void drain() {
+        unique_lock<mutex> lock(mLock);
+        for(;;) {
+            mWake.wait(lock, [this] { return mClosed || !mOutbox.empty(); });
+            if(mClosed) return;
+            string payload;
+            payload.swap(mOutbox.front());
+            mOutbox.pop_front();
+            mQueued -= payload.size();
+            lock.unlock();
+            bool sent = writeFrame(mFd, payload);
+            lock.lock();
+            if(!sent) {
+                closeLocked();
+                return;
+            }
+            mWritten++;
+            mRoom.notify_all();
+        }
+    }
+
+    // Stops the writing and wakes a read or write blocked on the socket.
+    void shut() {
+        lock_guard<mutex> lock(mLock);
+        closeLocked();
+    }
+
+    private:
+    void closeLocked() {
+        if(mClosed) return;
+        mClosed = true;
+        mOutbox.clear();
+        mQueued = 0;
+        mWake.notify_all();
+        mRoom.notify_all();
+        shutdown(mFd, SHUT_RDWR);
+    }
+};
+
+struct ServiceRequest {
+    shared_ptr<ServiceConnection> mConnection;
+    uint32_t mId;
+    uint64_t mLimit;
+    DeckTables mTables;
+    NogoodStore mNogoods;
+    atomic<bool> mStop;
+    atomic<int> mStatus;
+    atomic<uint64_t> mSolutions;
+    atomic<size_t> mPending;    // tasks not yet done
+
+    ServiceRequest() : mStop(false), mStatus(STATUS_RUNNING), mSolutions(0), mPending(0) {
+    }
+
+    // The first reason to stop is the one reported.
+    void stop(int status) {
+        int running = STATUS_RUNNING;
+        mStatus.compare_exchange_strong(running, status);
+        mStop.store(true);
+    }
+};
+
+struct ServiceTask {
+    shared_ptr<ServiceRequest> mRequest;
+    Task mTask;
+};
+
+struct alignas(64) ServiceQueue {
+    mutex mLock;
+    deque<ServiceTask> mTasks;
+};
+
+class SolverService {
+    public:
+    typedef chrono::steady_clock Clock;
+
+    int mThreads;
+    vector<ServiceQueue> mQueues;
+    atomic<size_t> mQueued;
+    size_t mNextQueue;          // where the next request's tasks are dealt
+    mutex mIdleLock;
+    condition_variable mIdle;
+    mutex mDeadlineLock;
+    condition_variable mDeadlineWake;
+    multimap<Clock::time_point, weak_ptr<ServiceRequest> > mDeadlines;
+
+    SolverService(int threads) : mQueues(threads), mQueued(0) {
+        mThreads = threads;
+        mNextQueue = 0;
+    }
+
+    // Runs until the process ends, or returns false with the reason when
+    // the socket cannot be set up.
+    bool serve(const string& path, string& error) {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if(path.size() >= sizeof(address.sun_path)) {
+            error = "socket path too long";
+            return false;
+        }
+        strcpy(address.sun_path, path.c_str());
+        // A socket left by an earlier run is replaced, anything else kept,
+        // as is a socket that a running service still accepts on.
+        struct stat existing;
+        if(lstat(path.c_str(), &existing) == 0) {
+            if(!S_ISSOCK(existing.st_mode)) {
+                error = path + " exists and is not a socket";
+                return false;
+            }
+            int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+            bool live = probe >= 0 && connect(probe, (sockaddr*)&address, sizeof(address)) == 0;
+            if(probe >= 0) close(probe);
+            if(live) {
+                error = "already serving on " + path;
+                return false;
+            }
+            unlink(path.c_str());
+        }
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(listener < 0 || ::bind(listener, (sockaddr*)&address, sizeof(address)) < 0 ||
+           listen(listener, 64) < 0) {
+            error = string("cannot listen on ") + path + ": " + strerror(errno);
+            if(listener >= 0) close(listener);
+            return false;
+        }
+        for(int w=0; w<mThreads; w++) {
+            thread(&SolverService::work, this, w).detach();
+        }
+        thread(&SolverService::watchDeadlines, this).detach();
+        for(;;) {
+            int fd = accept(listener, NULL, NULL);
+            if(fd < 0) {
+                if(errno == EINTR || errno == ECONNABORTED) continue;
+                error = string("accept: ") + strerror(errno);
+                close(listener);
+                return false;
+            }
+            thread(&SolverService::receive, this,
+                   make_shared<ServiceConnection>(fd)).detach();
+        }
+    }
+
+    // Reads the frames of one client. Closing the connection cancels its
+    // requests. A request is only referenced by its tasks, so once it has
+    // been answered its entry has expired and is dropped at the next one.
+    void receive(shared_ptr<ServiceConnection> connection) {
+        thread writer(&ServiceConnection::drain, connection.get());
+        map<uint32_t, weak_ptr<ServiceRequest> > requests;
+        string payload;
+        while(readFrame(connection->mFd, payload)) {
+            if(payload[0] == FRAME_SOLVE && payload.size() >= 17) {
+                for(auto entry = requests.begin(); entry != requests.end();) {
+                    if(entry->second.expired()) entry = requests.erase(entry);
+                    else ++entry;
+                }
+                shared_ptr<ServiceRequest> request = submit(connection, payload);
+                if(request) requests[request->mId] = request;
+            }
+            else if(payload[0] == FRAME_CANCEL && payload.size() >= 5) {
+                auto found = requests.find(getU32(&payload[1]));
+                if(found == requests.end()) continue;
+                shared_ptr<ServiceRequest> request = found->second.lock();
+                if(request) request->stop(STATUS_CANCELLED);
+                requests.erase(found);
+            }
+            else {
+                break;
+            }
+        }
+        for(const auto& entry : requests) {
+            shared_ptr<ServiceRequest> request = entry.second.lock();
+            if(request) request->stop(STATUS_CANCELLED);
+        }
+        connection->shut();
+        writer.join();
+    }
+
+    shared_ptr<ServiceRequest> submit(const shared_ptr<ServiceConnection>& connection,
+                                      const string& payload) {
+        auto request = make_shared<ServiceRequest>();
+        request->mConnection = connection;
+        request->mId = getU32(&payload[1]);
+        uint32_t deadline = getU32(&payload[5]);
+        request->mLimit = getU64(&payload[9]);
+
+        istringstream in(payload.substr(17));
+        vector<Card> deck;
+        string error;
+        if(!readDeck(in, deck, error)) {
+            request->mStatus = STATUS_INVALID;
+            finish(*request, error);
+            return NULL;
+        }
+        request->mTables.build(deck.data(), deck.size());
+        request->mTables.filter();
+        vector<Task> tasks = ParallelSolver::expand(&request->mTables, 16 * mThreads);
+        if(tasks.empty()) {
+            request->mStatus = STATUS_COMPLETE;
+            finish(*request);
+            return NULL;
+        }
+        if(deadline > 0) {
+            lock_guard<mutex> lock(mDeadlineLock);
+            mDeadlines.insert(make_pair(Clock::now() + chrono::milliseconds(deadline),
+                                        weak_ptr<ServiceRequest>(request)));
+            mDeadlineWake.notify_one();
+        }
+        request->mPending = tasks.size();
+        // Counted before they are pushed, so that take() never counts down a
+        // task that is not counted yet. Idle workers woken in between find
+        // the queues empty and wait again.
+        size_t first;
+        {
+            lock_guard<mutex> lock(mIdleLock);
+            first = mNextQueue;
+            mNextQueue = (mNextQueue + tasks.size()) % mThreads;
+            mQueued += tasks.size();
+        }
+        for(size_t i=0; i<tasks.size(); i++) {
+            ServiceQueue& queue = mQueues[(first + i) % mThreads];
+            lock_guard<mutex> lock(queue.mLock);
+            queue.mTasks.push_back(ServiceTask{ request, tasks[i] });
+        }
+        mIdle.notify_all();
+        return request;
+    }
+
+    bool take(int worker, ServiceTask& task) {
+        for(int i=0; i<mThreads; i++) {
+            ServiceQueue& queue = mQueues[(worker + i) % mThreads];
+            lock_guard<mutex> lock(queue.mLock);
+            if(queue.mTasks.empty()) continue;
+            if(i == 0) {
+                task = queue.mTasks.front();
+                queue.mTasks.pop_front();
+            }
+            else {
+                task = queue.mTasks.back();
+                queue.mTasks.pop_back();
+            }
+            mQueued--;
+            return true;
+        }
+        return false;
+    }
+
+    void work(int worker) {
+        for(;;) {
+            ServiceTask task;
+            if(!take(worker, task)) {
+                unique_lock<mutex> lock(mIdleLock);
+                mIdle.wait(lock, [this] { return mQueued.load() > 0; });
+                continue;
+            }
+            ServiceRequest& request = *task.mRequest;
+            if(!request.mStop) run(request, task.mTask);
+            if(--request.mPending == 0) {
+                int running = STATUS_RUNNING;
+                request.mStatus.compare_exchange_strong(running, STATUS_COMPLETE);
+                finish(request);
+            }
+        }
+    }
+
+    void run(ServiceRequest& request, const Task& task) {
+        const DeckTables& tables = request.mTables;
+        string frame(1, FRAME_SOLUTION);
+        putU32(frame, request.mId);
+        size_t header = frame.size();
+        auto report = [&](Search& s) {
+            uint64_t n = request.mSolutions++;
+            if(request.mLimit && n >= request.mLimit) {
+                request.mSolutions--;
+                s.mStopped = true;
+                return;
+            }
+            frame.resize(header);
+            for(sint i=0; i<tables.mCards; i++) {
+                sint p = tables.mPrintOrder[i];
+                frame += (char)(s.mCard[p] | (s.mRotation[p] << 6));
+            }
+            bool stalled = false;
+            if(!request.mConnection->send(frame, false, &request.mStop, &stalled)) {
+                // Dropped, so not one of the solutions sent.
+                request.mSolutions--;
+                request.stop(stalled ? STATUS_STALLED : STATUS_CANCELLED);
+                s.mStopped = true;
+                return;
+            }
+            if(request.mLimit && n + 1 == request.mLimit) {
+                request.stop(STATUS_LIMIT);
+            }
+        };
+        Search search(&tables);
+        search.restore(task);
+        search.mNogoods = &request.mNogoods;
+        search.mCancel = &request.mStop;
+        if(task.mDepth == tables.mCards) {
+            report(search);
+        }
+        else {
+            search.solve(task.mDepth, report);
+        }
+    }
+
+    void finish(ServiceRequest& request, const string& reason = "") {
+        string frame(1, FRAME_DONE);
+        putU32(frame, request.mId);
+        frame += (char)request.mStatus.load();
+        putU64(frame, request.mSolutions.load());
+        frame += reason;
+        request.mConnection->send(frame, true);
+    }
+
+    // Sleeps until the earliest deadline and stops the request if it is
+    // still running.
+    void watchDeadlines() {
+        unique_lock<mutex> lock(mDeadlineLock);
+        for(;;) {
+            if(mDeadlines.empty()) {
+                mDeadlineWake.wait(lock);
+                continue;
+            }
+            auto first = mDeadlines.begin();
+            if(Clock::now() < first->first) {
+                mDeadlineWake.wait_until(lock, first->first);
+                continue;
+            }
+            shared_ptr<ServiceRequest> request = first->second.lock();
+            mDeadlines.erase(first);
+            if(request) request->stop(STATUS_DEADLINE);
+        }
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// SOLVER CLIENT:
+// Sends one deck to a running service and calls onSolution with each record
+// as it arrives. Returns the status the service ended the request with and
+// its reason, or STATUS_INVALID with the reason when the service cannot be
+// reached.
+
+template<class OnSolution>
+int requestSolutions(const string& path, const vector<Card>& deck, uint32_t deadline,
+                     uint64_t limit, OnSolution onSolution, string& reason) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path)) {
+        reason = "socket path too long";
+        return STATUS_INVALID;
+    }
+    strcpy(address.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) < 0) {
+        reason = string("cannot connect to ") + path + ": " + strerror(errno);
+        if(fd >= 0) close(fd);
+        return STATUS_INVALID;
+    }
+    string frame(1, FRAME_SOLVE);
+    putU32(frame, 1);
+    putU32(frame, deadline);
+    putU64(frame, limit);
+    ostringstream text;
+    writeDeck(text, deck);
+    frame += text.str();
+    string payload;
+    int status = STATUS_INVALID;
+    reason = "connection lost";
+    if(writeFrame(fd, frame)) {
+        while(readFrame(fd, payload)) {
+            if(payload[0] == FRAME_SOLUTION && payload.size() == 5 + deck.size()) {
+                onSolution(payload.data() + 5);
+            }
+            else if(payload[0] == FRAME_DONE && payload.size() >= 14) {
+                status = (unsigned char)payload[5];
+                reason = payload.substr(14);
+                if(reason.empty()) reason = statusMessage(status);
+                break;
+            }
+        }
+    }
+    close(fd);
+    return status;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
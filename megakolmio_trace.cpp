@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#include "megakolmio_trace.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Reads a dump written by megakolmio --trace=FILE and prints the last N
+// events of all threads in time order, or converts the whole dump to the
+// Chrome trace event format (chrome://tracing, Perfetto).
+
+static bool readDump(const char* path, vector<TraceRecord>& records) {
+    ifstream in(path, ios::binary);
+    char magic[sizeof(TRACE_MAGIC)];
+    uint32_t threads = 0;
+    if(!in.read(magic, sizeof(magic)) ||
+       memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0 ||
+       !in.read((char*)&threads, sizeof(threads))) {
+        return false;
+    }
+    for(uint32_t i=0; i<threads; i++) {
+        TraceHeader header;
+        if(!in.read((char*)&header, sizeof(header))) return false;
+        size_t first = records.size();
+        records.resize(first + header.mRecords);
+        if(!in.read((char*)&records[first], header.mRecords * sizeof(TraceRecord))) {
+            return false;
+        }
+    }
+    stable_sort(records.begin(), records.end(),
+        [](const TraceRecord& a, const TraceRecord& b) { return a.mTime < b.mTime; });
+    return true;
+}
+
+static const char* eventName(const TraceRecord& r) {
+    return r.mEvent < TRACE_EVENTS ? TRACE_EVENT_NAMES[r.mEvent] : "unknown";
+}
+
+static void printLast(const vector<TraceRecord>& records, size_t last) {
+    size_t from = records.size() > last ? records.size() - last : 0;
+    uint64_t base = records.empty() ? 0 : records[0].mTime;
+    for(size_t i=from; i<records.size(); i++) {
+        const TraceRecord& r = records[i];
+        cout << r.mTime - base << "ns"
+             << " thread=" << r.mThread
+             << " " << eventName(r)
+             << " depth=" << (int)r.mDepth
+             << " card=" << (int)r.mCard
+             << " rotation=" << (int)r.mRotation << endl;
+    }
+}
+
+static bool writeChrome(const vector<TraceRecord>& records, const char* path) {
+    ofstream out(path);
+    if(!out) return false;
+    uint64_t base = records.empty() ? 0 : records[0].mTime;
+    out << "{\"traceEvents\":[" << endl;
+    for(size_t i=0; i<records.size(); i++) {
+        const TraceRecord& r = records[i];
+        uint64_t ns = r.mTime - base;
+        out << "{\"name\":\"" << eventName(r) << "\",\"ph\":\"i\",\"s\":\"t\""
+            << ",\"ts\":" << ns / 1000 << "." << (ns % 1000) / 100
+            << ",\"pid\":1,\"tid\":" << r.mThread
+            << ",\"args\":{\"depth\":" << (int)r.mDepth
+            << ",\"card\":" << (int)r.mCard
+            << ",\"rotation\":" << (int)r.mRotation << "}}";
+        if(i < records.size()-1) out << ",";
+        out << endl;
+    }
+    out << "]}" << endl;
+    return (bool)out;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void usage() {
+    cerr << "usage: megakolmio_trace [--last=N] [--chrome=OUT.json] DUMP" << endl
+         << "  --last=N          print the last N events (default 50)" << endl
+         << "  --chrome=OUT.json write all events as Chrome trace JSON" << endl;
+}
+
+int main(int argc, char** argv) {
+    size_t last = 50;
+    const char* chrome = NULL;
+    const char* dump = NULL;
+    for(int i=1; i<argc; i++) {
+        if(strncmp(argv[i], "--last=", 7) == 0) {
+            last = strtoul(argv[i] + 7, NULL, 10);
+        }
+        else if(strncmp(argv[i], "--chrome=", 9) == 0) {
+            chrome = argv[i] + 9;
+        }
+        else if(argv[i][0] != '-' && dump == NULL) {
+            dump = argv[i];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if(dump == NULL) {
+        usage();
+        return 1;
+    }
+
+    vector<TraceRecord> records;
+    if(!readDump(dump, records)) {
+        cerr << "megakolmio_trace: cannot read " << dump << endl;
+        return 1;
+    }
+    if(chrome) {
+        if(!writeChrome(records, chrome)) {
+            cerr << "megakolmio_trace: cannot write " << chrome << endl;
+            return 1;
+        }
+    }
+    else {
+        printLast(records, last);
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,173 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MEGAKOLMIO_TRACE_HPP
+#define MEGAKOLMIO_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#ifdef MEGAKOLMIO_TRACE
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+// TRACING:
+// Build with -DMEGAKOLMIO_TRACE to enable the TRACE() points in the search.
+// Every thread writes fixed-size records into its own ring buffer, so a trace
+// point costs a clock read and a 16 byte store. Without the define TRACE()
+// expands to nothing.
+//
+// A dump file starts with TRACE_MAGIC and the number of threads, followed by
+// a TraceHeader and the records (oldest first) of each thread. Use
+// megakolmio_trace to print or convert it.
+
+enum TraceEvent {
+    TRACE_PLACE,        // card put on an empty position with rotation 0
+    TRACE_ROTATE,       // card on the position turned to the next rotation
+    TRACE_PRUNE,        // partial board does not match, subtree skipped
+    TRACE_SOLUTION,     // complete board found
+    TRACE_BACKJUMP,     // dead end, search resumes at the depth in mCard
+    TRACE_EVENTS
+};
+
+static const char* const TRACE_EVENT_NAMES[TRACE_EVENTS] = {
+    "place", "rotate", "prune", "solution", "backjump"
+};
+
+static const char TRACE_MAGIC[8] = {'M','K','T','R','A','C','E','1'};
+
+struct TraceRecord {
+    uint64_t mTime;     // nanoseconds of steady_clock
+    uint32_t mThread;
+    uint8_t mEvent;
+    uint8_t mDepth;
+    uint8_t mCard;
+    uint8_t mRotation;
+};
+
+struct TraceHeader {
+    uint32_t mThread;
+    uint32_t mRecords;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef MEGAKOLMIO_TRACE
+
+class TraceBuffer {
+    public:
+    static const uint32_t SIZE = 1 << 16;   // records, power of two
+    std::atomic<uint64_t> mNext;    // records written, stored by the owner only
+    uint32_t mThread;
+    TraceRecord mRecords[SIZE];
+
+    void add(uint8_t event, uint8_t depth, uint8_t card, uint8_t rotation) {
+        uint64_t next = mNext.load(std::memory_order_relaxed);
+        TraceRecord& r = mRecords[next & (SIZE - 1)];
+        r.mTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        r.mThread = mThread;
+        r.mEvent = event;
+        r.mDepth = depth;
+        r.mCard = card;
+        r.mRotation = rotation;
+        mNext.store(next + 1, std::memory_order_release);
+    }
+};
+
+// Buffers are never freed so that threads that have finished still show up
+// in the dump. A thread takes a slot and then publishes its buffer there, so
+// the dump skips slots that are taken but still empty. Threads beyond
+// TRACE_MAX_THREADS get no buffer and are not traced.
+static const uint32_t TRACE_MAX_THREADS = 256;
+inline std::atomic<TraceBuffer*> traceBuffers[TRACE_MAX_THREADS];
+inline std::atomic<uint32_t> traceThreads(0);
+inline char tracePath[4096];
+
+inline TraceBuffer* registerTraceBuffer() {
+    uint32_t id = traceThreads.fetch_add(1);
+    if(id >= TRACE_MAX_THREADS) return NULL;
+    TraceBuffer* buffer = new TraceBuffer();
+    buffer->mNext = 0;
+    buffer->mThread = id;
+    traceBuffers[id].store(buffer, std::memory_order_release);
+    return buffer;
+}
+
+inline TraceBuffer* traceBuffer() {
+    static thread_local TraceBuffer* buffer = registerTraceBuffer();
+    return buffer;
+}
+
+#define TRACE(event, depth, card, rotation) \
+    do { \
+        TraceBuffer* traceTo = traceBuffer(); \
+        if(traceTo) traceTo->add((event), (depth), (card), (rotation)); \
+    } while(0)
+
+// Writes all buffers to tracePath. Only uses async-signal-safe calls so it
+// can run from the SIGUSR1 handler while the search is going on. The count
+// is loaded with acquire before the records are copied, so the records it
+// covers are complete, but a thread that keeps going may overwrite them,
+// oldest first, while they are being copied. The dump then holds some of its
+// newer records in their place.
+inline void dumpTrace() {
+    int fd = open(tracePath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) return;
+    uint32_t slots = traceThreads.load();
+    if(slots > TRACE_MAX_THREADS) slots = TRACE_MAX_THREADS;
+    const TraceBuffer* buffers[TRACE_MAX_THREADS];
+    uint32_t threads = 0;
+    for(uint32_t i=0; i<slots; i++) {
+        const TraceBuffer* b = traceBuffers[i].load(std::memory_order_acquire);
+        if(b) buffers[threads++] = b;
+    }
+    bool ok = write(fd, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == sizeof(TRACE_MAGIC) &&
+              write(fd, &threads, sizeof(threads)) == sizeof(threads);
+    for(uint32_t i=0; ok && i<threads; i++) {
+        const TraceBuffer* b = buffers[i];
+        uint64_t next = b->mNext.load(std::memory_order_acquire);
+        uint64_t count = next < TraceBuffer::SIZE ? next : TraceBuffer::SIZE;
+        TraceHeader header = { b->mThread, (uint32_t)count };
+        ok = write(fd, &header, sizeof(header)) == sizeof(header);
+        uint64_t start = (next - count) & (TraceBuffer::SIZE - 1);
+        uint64_t first = count < TraceBuffer::SIZE - start ? count : TraceBuffer::SIZE - start;
+        ssize_t size = first * sizeof(TraceRecord);
+        if(ok) ok = write(fd, &b->mRecords[start], size) == size;
+        size = (count - first) * sizeof(TraceRecord);
+        if(ok && size > 0) ok = write(fd, &b->mRecords[0], size) == size;
+    }
+    close(fd);
+}
+
+inline void dumpTraceOnSignal(int) {
+    dumpTrace();
+}
+
+// Remembers where to dump and dumps on every SIGUSR1.
+inline bool startTrace(const char* path) {
+    if(strlen(path) >= sizeof(tracePath)) return false;
+    strcpy(tracePath, path);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = dumpTraceOnSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    return sigaction(SIGUSR1, &action, NULL) == 0;
+}
+
+#else
+
+#define TRACE(event, depth, card, rotation) ((void)0)
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,267 @@
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MEGAKOLMIO_VERIFY_HPP
+#define MEGAKOLMIO_VERIFY_HPP
+
+#include "megakolmio.hpp"
+
+#include <string_view>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// SOLUTION FILES:
+// Text solutions are what the solver prints: card names in print order,
+// "[P9,P7,P2,P1,P8,P6,P5,P4,P3]". A name may carry its rotation,
+// "P9:2"; names without one may take any rotations that make the board
+// match, also when other names of the record carry theirs.
+//
+// Binary solutions start with SOLUTION_MAGIC and the number of cells as a
+// 32 bit little endian integer, followed by records of one byte per cell in
+// print order: card index in the low 6 bits, rotation in the high 2 bits.
+
+static const char SOLUTION_MAGIC[8] = {'M','K','S','O','L','V','E','1'};
+
+inline void writeBinaryHeader(ostream& out, uint32_t cells) {
+    unsigned char size[4] = { (unsigned char)cells, (unsigned char)(cells >> 8),
+                              (unsigned char)(cells >> 16), (unsigned char)(cells >> 24) };
+    out.write(SOLUTION_MAGIC, sizeof(SOLUTION_MAGIC));
+    out.write((const char*)size, sizeof(size));
+}
+
+inline void writeBinarySolution(ostream& out, const Search& s) {
+    char record[MAX_CARDS];
+    for(sint i=0; i<s.mTables->mCards; i++) {
+        sint p = s.mTables->mPrintOrder[i];
+        record[i] = (char)(s.mCard[p] | (s.mRotation[p] << 6));
+    }
+    out.write(record, s.mTables->mCards);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// VERIFIER:
+// Checks every record of a solution file against a deck with the compact
+// tables: each card used once and every common edge matching, the same as
+// GameState::isSolved(false). The file is split into one chunk per thread at
+// record boundaries; a thread stops once a chunk before its own has an
+// invalid record, since only the first one is reported.
+
+class Verifier {
+    public:
+    const DeckTables* mTables;
+    unordered_map<string_view, sint> mCardIndex;
+    int mThreads;
+
+    struct Chunk {
+        const char* mBegin;
+        const char* mEnd;
+        uint64_t mRecords;      // records checked, up to the invalid one
+        uint64_t mLines;        // lines read, up to the invalid one
+        bool mInvalid;
+        string mReason;
+    };
+
+    // Result of verify()
+    uint64_t mRecords;
+    uint64_t mInvalidRecord;    // 1-based, 0 if all records are valid
+    uint64_t mInvalidLine;      // 1-based line of a text file
+    string mReason;
+
+    Verifier(const DeckTables* tables, int threads) {
+        mTables = tables;
+        mThreads = max(1, threads);
+        for(sint c=0; c<tables->mCards; c++) {
+            mCardIndex[tables->mDeck[c].mName] = c;
+        }
+    }
+
+    // Rotations for the positions of a board that are not in rotated, the
+    // others keep the rotation they have.
+    bool rotate(Search& s, sint position, uint64_t rotated) const {
+        if(position == mTables->mCards) return true;
+        if(rotated & (1ull << position)) {
+            return s.fits(position, s.mCard[position], s.mRotation[position]) &&
+                   rotate(s, position + 1, rotated);
+        }
+        for(sint r=0; r<EDGES_IN_CARD; r++) {
+            if(s.fits(position, s.mCard[position], r)) {
+                s.mRotation[position] = r;
+                if(rotate(s, position + 1, rotated)) return true;
+            }
+        }
+        return false;
+    }
+
+    const char* checkBoard(Search& s, uint64_t rotated) const {
+        if(s.mUsed != mTables->mAllCards) return "a card is missing or repeated";
+        if(rotated == mTables->mAllCards) {
+            if(!s.isSolved()) return "edges do not match";
+        }
+        else if(!rotate(s, 0, rotated)) {
+            return rotated ? "no rotations of the unrotated cards make the edges match"
+                           : "no rotations make the edges match";
+        }
+        return NULL;
+    }
+
+    const char* checkText(Search& s, const char* begin, const char* end) const {
+        if(end - begin < 2 || *begin != '[' || end[-1] != ']') return "not [name,...]";
+        s.mUsed = 0;
+        uint64_t rotated = 0;       // positions whose rotation is given
+        sint cell = 0;
+        const char* p = begin + 1;
+        for(;;) {
+            const char* name = p;
+            while(p < end - 1 && *p != ',' && *p != ':') p++;
+            if(cell == mTables->mCards) return "too many cards";
+            auto found = mCardIndex.find(string_view(name, p - name));
+            if(found == mCardIndex.end()) return "unknown card";
+            sint c = found->second;
+            sint position = mTables->mPrintOrder[cell++];
+            if(s.mUsed & (1ull << c)) return "a card is missing or repeated";
+            s.mUsed |= 1ull << c;
+            s.mCard[position] = c;
+            if(*p == ':') {
+                p++;
+                if(p >= end - 1 || *p < '0' || *p >= '0' + EDGES_IN_CARD) return "bad rotation";
+                s.mRotation[position] = *p++ - '0';
+                rotated |= 1ull << position;
+            }
+            if(p == end - 1) break;
+            if(*p != ',') return "bad separator";
+            p++;
+        }
+        if(cell != mTables->mCards) return "too few cards";
+        return checkBoard(s, rotated);
+    }
+
+    const char* checkBinary(Search& s, const unsigned char* record) const {
+        s.mUsed = 0;
+        for(sint i=0; i<mTables->mCards; i++) {
+            sint c = record[i] & 63;
+            sint r = record[i] >> 6;
+            if(c >= mTables->mCards) return "unknown card";
+            if(r >= EDGES_IN_CARD) return "bad rotation";
+            s.mUsed |= 1ull << c;
+            sint position = mTables->mPrintOrder[i];
+            s.mCard[position] = c;
+            s.mRotation[position] = r;
+        }
+        return checkBoard(s, mTables->mAllCards);
+    }
+
+    void verifyChunk(Chunk& chunk, bool binary, const atomic<size_t>& firstInvalid,
+                     size_t index) const {
+        Search s(mTables);
+        const char* p = chunk.mBegin;
+        while(p < chunk.mEnd) {
+            // Polling every record is cheap next to the check itself.
+            if(firstInvalid.load(memory_order_relaxed) < index) return;
+            const char* reason;
+            if(binary) {
+                reason = checkBinary(s, (const unsigned char*)p);
+                p += mTables->mCards;
+            }
+            else {
+                const char* eol = (const char*)memchr(p, '\n', chunk.mEnd - p);
+                if(eol == NULL) eol = chunk.mEnd;
+                const char* end = eol;
+                if(end > p && end[-1] == '\r') end--;
+                chunk.mLines++;
+                if(end == p) {
+                    p = eol + 1;
+                    continue;
+                }
+                reason = checkText(s, p, end);
+                p = eol + 1;
+            }
+            chunk.mRecords++;
+            if(reason) {
+                chunk.mInvalid = true;
+                chunk.mReason = reason;
+                return;
+            }
+        }
+    }
+
+    // Returns false if the file is not a solution file for this deck.
+    bool verify(const char* data, size_t size, string& error) {
+        bool binary = size >= sizeof(SOLUTION_MAGIC) &&
+                      memcmp(data, SOLUTION_MAGIC, sizeof(SOLUTION_MAGIC)) == 0;
+        const char* begin = data;
+        const char* end = data + size;
+        if(binary) {
+            if(size < sizeof(SOLUTION_MAGIC) + 4) {
+                error = "truncated header";
+                return false;
+            }
+            const unsigned char* header = (const unsigned char*)data + sizeof(SOLUTION_MAGIC);
+            uint32_t cells = header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24;
+            if(cells != (uint32_t)mTables->mCards) {
+                error = "solutions are for " + to_string(cells) + " cells, the deck has " +
+                        to_string(mTables->mCards);
+                return false;
+            }
+            begin += sizeof(SOLUTION_MAGIC) + 4;
+            if((end - begin) % cells != 0) {
+                error = "truncated record";
+                return false;
+            }
+        }
+
+        // Chunk boundaries on whole records.
+        vector<Chunk> chunks;
+        size_t length = end - begin;
+        const char* from = begin;
+        for(int t=0; t<mThreads && from < end; t++) {
+            const char* to = t == mThreads - 1 ? end : begin + length * (t + 1) / mThreads;
+            if(to < from) to = from;
+            if(binary) {
+                to = begin + (to - begin) / mTables->mCards * mTables->mCards;
+            }
+            else if(to < end) {
+                const char* eol = (const char*)memchr(to, '\n', end - to);
+                to = eol ? eol + 1 : end;
+            }
+            if(to > from) chunks.push_back(Chunk{ from, to, 0, 0, false, "" });
+            from = to;
+        }
+
+        atomic<size_t> firstInvalid(chunks.size());
+        auto run = [&](size_t i) {
+            verifyChunk(chunks[i], binary, firstInvalid, i);
+            if(chunks[i].mInvalid) {
+                size_t seen = firstInvalid.load();
+                while(i < seen && !firstInvalid.compare_exchange_weak(seen, i)) {}
+            }
+        };
+        vector<thread> workers;
+        for(size_t i=1; i<chunks.size(); i++) {
+            workers.push_back(thread(run, i));
+        }
+        if(!chunks.empty()) run(0);
+        for(thread& t : workers) t.join();
+
+        mRecords = mInvalidRecord = mInvalidLine = 0;
+        mReason.clear();
+        for(const Chunk& chunk : chunks) {
+            if(chunk.mInvalid) {
+                mInvalidRecord = mRecords + chunk.mRecords;
+                mInvalidLine = binary ? 0 : mInvalidLine + chunk.mLines;
+                mReason = chunk.mReason;
+                mRecords += chunk.mRecords;
+                return true;
+            }
+            mRecords += chunk.mRecords;
+            mInvalidLine += chunk.mLines;
+        }
+        mInvalidLine = 0;
+        return true;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////